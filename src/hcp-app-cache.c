@@ -0,0 +1,370 @@
+/*
+ * This file is part of hildon-control-panel
+ *
+ * Copyright (C) 2010 Nokia Corporation.
+ *
+ * Contact: Karoliina Salminen <karoliina.t.salminen@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "hcp-app-cache.h"
+#include "hcp-desktop-entry.h"
+
+#define HCP_APP_CACHE_MAGIC    "HCPCACHE"
+#define HCP_APP_CACHE_VERSION  3
+#define HCP_APP_CACHE_SUBDIR   "hildon-control-panel"
+
+/*
+ * File layout (host byte order, the file never leaves the device):
+ *
+ *   HCPAppCacheHeader
+ *   HCPAppCacheRecord [n_entries]
+ *   string pool [strings_size]
+ *
+ * Strings are stored as offsets into the pool. The pool starts with
+ * a NUL byte so offset 0 can stand for a NULL string.
+ */
+typedef struct {
+  gchar         magic[8];
+  guint32       version;
+  guint32       n_entries;
+  HCPFileStamp  dir_stamp;
+  HCPFileStamp  pos_stamp;
+  guint32       path;          /* the file name only hashes it */
+  guint32       locale;
+  guint32       strings_size;
+} HCPAppCacheHeader;
+
+typedef struct {
+  HCPFileStamp  stamp;
+  guint32  filename;
+  guint32  name;
+  guint32  plugin;
+  guint32  icon;
+  guint32  category;
+  guint32  text_domain;
+  guint32  requires;
+  gint32   pos;
+} HCPAppCacheRecord;
+
+typedef struct {
+  GByteArray *pool;
+  GHashTable *offsets;
+} HCPAppCacheStrings;
+
+static gchar *
+hcp_app_cache_get_path (const gchar *dir_path)
+{
+  gchar *basename;
+  gchar *path;
+
+  basename = g_strdup_printf ("applets-%08x.cache", g_str_hash (dir_path));
+
+  path = g_build_filename (g_get_user_cache_dir (),
+                           HCP_APP_CACHE_SUBDIR,
+                           basename,
+                           NULL);
+
+  g_free (basename);
+
+  return path;
+}
+
+/* Applet names are translated through the locale chain, so the
+ * catalog is bound to the languages it was built for */
+static gchar *
+hcp_app_cache_get_locale (void)
+{
+  return g_strjoinv (":", (gchar **) g_get_language_names ());
+}
+
+static gboolean
+hcp_app_cache_get_string (const gchar  *strings,
+                          guint32       strings_size,
+                          guint32       offset,
+                          const gchar **value)
+{
+  *value = NULL;
+
+  if (offset == 0)
+    return TRUE;
+
+  if (offset >= strings_size)
+    return FALSE;
+
+  *value = strings + offset;
+
+  return TRUE;
+}
+
+gboolean
+hcp_app_cache_load (const gchar        *dir_path,
+                    const HCPFileStamp *pos_stamp,
+                    HCPFileStamp       *dir_stamp,
+                    GHashTable         *entries)
+{
+  GMappedFile *mapped;
+  const HCPAppCacheHeader *header;
+  const HCPAppCacheRecord *records;
+  const gchar *contents;
+  const gchar *strings;
+  gchar *cache_path;
+  const gchar *locale = NULL;
+  const gchar *path = NULL;
+  gsize length;
+  gboolean valid = FALSE;
+  guint i;
+
+  g_return_val_if_fail (dir_path, FALSE);
+  g_return_val_if_fail (pos_stamp, FALSE);
+  g_return_val_if_fail (entries, FALSE);
+
+  cache_path = hcp_app_cache_get_path (dir_path);
+
+  /* A missing cache is not an error, it just means a cold start */
+  mapped = g_mapped_file_new (cache_path, FALSE, NULL);
+
+  g_free (cache_path);
+
+  if (!mapped)
+    return FALSE;
+
+  contents = g_mapped_file_get_contents (mapped);
+  length = g_mapped_file_get_length (mapped);
+
+  if (length < sizeof (HCPAppCacheHeader))
+    goto cleanup;
+
+  header = (const HCPAppCacheHeader *) contents;
+
+  if (memcmp (header->magic, HCP_APP_CACHE_MAGIC, sizeof (header->magic)) ||
+      header->version != HCP_APP_CACHE_VERSION)
+    goto cleanup;
+
+  if (!hcp_file_stamp_equal (&header->pos_stamp, pos_stamp))
+    goto cleanup;
+
+  if (header->n_entries > (length - sizeof (HCPAppCacheHeader)) /
+                          sizeof (HCPAppCacheRecord))
+    goto cleanup;
+
+  if (length != sizeof (HCPAppCacheHeader) +
+                header->n_entries * sizeof (HCPAppCacheRecord) +
+                header->strings_size)
+    goto cleanup;
+
+  records = (const HCPAppCacheRecord *) (contents + sizeof (HCPAppCacheHeader));
+  strings = (const gchar *) (records + header->n_entries);
+
+  /* The pool must be NUL terminated for the offsets to be safe */
+  if (header->strings_size == 0 ||
+      strings[header->strings_size - 1] != '\0')
+    goto cleanup;
+
+  if (!hcp_app_cache_get_string (strings, header->strings_size,
+                                 header->locale, &locale) ||
+      !hcp_app_cache_get_string (strings, header->strings_size,
+                                 header->path, &path))
+    goto cleanup;
+
+  /* Another directory whose path hashes the same */
+  if (g_strcmp0 (path, dir_path) != 0)
+    goto cleanup;
+
+  {
+    gchar *current_locale = hcp_app_cache_get_locale ();
+    gboolean same_locale = (g_strcmp0 (locale, current_locale) == 0);
+
+    g_free (current_locale);
+
+    if (!same_locale)
+      goto cleanup;
+  }
+
+  for (i = 0; i < header->n_entries; i++)
+  {
+    const HCPAppCacheRecord *record = &records[i];
+    const gchar *filename, *name, *plugin, *icon;
+    const gchar *category, *text_domain, *requires;
+    HCPDesktopEntry *entry;
+    guint32 size = header->strings_size;
+
+    if (!hcp_app_cache_get_string (strings, size, record->filename, &filename) ||
+        !hcp_app_cache_get_string (strings, size, record->name, &name) ||
+        !hcp_app_cache_get_string (strings, size, record->plugin, &plugin) ||
+        !hcp_app_cache_get_string (strings, size, record->icon, &icon) ||
+        !hcp_app_cache_get_string (strings, size, record->category, &category) ||
+        !hcp_app_cache_get_string (strings, size, record->text_domain, &text_domain) ||
+        !hcp_app_cache_get_string (strings, size, record->requires, &requires) ||
+        !filename || !plugin)
+    {
+      g_hash_table_remove_all (entries);
+      goto cleanup;
+    }
+
+    entry = hcp_desktop_entry_new (filename, &record->stamp,
+                                   name, plugin, icon,
+                                   category, text_domain, requires);
+    entry->pos = record->pos;
+
+    g_hash_table_replace (entries, entry->filename, entry);
+  }
+
+  if (dir_stamp)
+    *dir_stamp = header->dir_stamp;
+
+  valid = TRUE;
+
+cleanup:
+  if (!valid)
+    g_debug ("Ignoring applet catalog cache for %s", dir_path);
+
+  g_mapped_file_unref (mapped);
+
+  return valid;
+}
+
+static guint32
+hcp_app_cache_add_string (HCPAppCacheStrings *strings, const gchar *value)
+{
+  gpointer offset;
+
+  if (value == NULL)
+    return 0;
+
+  /* Categories and text domains repeat across applets */
+  if (g_hash_table_lookup_extended (strings->offsets, value, NULL, &offset))
+    return GPOINTER_TO_UINT (offset);
+
+  offset = GUINT_TO_POINTER (strings->pool->len);
+
+  g_byte_array_append (strings->pool,
+                       (const guint8 *) value,
+                       strlen (value) + 1);
+
+  g_hash_table_insert (strings->offsets, (gpointer) value, offset);
+
+  return GPOINTER_TO_UINT (offset);
+}
+
+gboolean
+hcp_app_cache_save (const gchar        *dir_path,
+                    const HCPFileStamp *dir_stamp,
+                    const HCPFileStamp *pos_stamp,
+                    GHashTable         *entries)
+{
+  HCPAppCacheHeader header;
+  HCPAppCacheStrings strings;
+  GByteArray *data;
+  GHashTableIter iter;
+  gpointer value;
+  gchar *cache_path;
+  gchar *cache_dir;
+  gchar *locale;
+  GError *error = NULL;
+  gboolean ret;
+
+  g_return_val_if_fail (dir_path, FALSE);
+  g_return_val_if_fail (dir_stamp, FALSE);
+  g_return_val_if_fail (pos_stamp, FALSE);
+  g_return_val_if_fail (entries, FALSE);
+
+  strings.pool = g_byte_array_new ();
+  strings.offsets = g_hash_table_new (g_str_hash, g_str_equal);
+
+  /* offset 0 is reserved for NULL */
+  g_byte_array_append (strings.pool, (const guint8 *) "", 1);
+
+  locale = hcp_app_cache_get_locale ();
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, HCP_APP_CACHE_MAGIC, sizeof (header.magic));
+  header.version = HCP_APP_CACHE_VERSION;
+  header.n_entries = g_hash_table_size (entries);
+  header.dir_stamp = *dir_stamp;
+  header.pos_stamp = *pos_stamp;
+  header.path = hcp_app_cache_add_string (&strings, dir_path);
+  header.locale = hcp_app_cache_add_string (&strings, locale);
+
+  data = g_byte_array_sized_new (sizeof (HCPAppCacheHeader) +
+                                 header.n_entries * sizeof (HCPAppCacheRecord));
+
+  g_byte_array_set_size (data, sizeof (HCPAppCacheHeader));
+
+  g_hash_table_iter_init (&iter, entries);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+  {
+    HCPDesktopEntry *entry = (HCPDesktopEntry *) value;
+    HCPAppCacheRecord record;
+
+    memset (&record, 0, sizeof (record));
+
+    record.stamp = entry->stamp;
+    record.filename = hcp_app_cache_add_string (&strings, entry->filename);
+    record.name = hcp_app_cache_add_string (&strings, entry->name);
+    record.plugin = hcp_app_cache_add_string (&strings, entry->plugin);
+    record.icon = hcp_app_cache_add_string (&strings, entry->icon);
+    record.category = hcp_app_cache_add_string (&strings, entry->category);
+    record.text_domain = hcp_app_cache_add_string (&strings, entry->text_domain);
+    record.requires = hcp_app_cache_add_string (&strings, entry->requires);
+    record.pos = entry->pos;
+
+    g_byte_array_append (data, (const guint8 *) &record, sizeof (record));
+  }
+
+  header.strings_size = strings.pool->len;
+  memcpy (data->data, &header, sizeof (header));
+
+  g_byte_array_append (data, strings.pool->data, strings.pool->len);
+
+  cache_path = hcp_app_cache_get_path (dir_path);
+  cache_dir = g_path_get_dirname (cache_path);
+
+  g_mkdir_with_parents (cache_dir, 0755);
+
+  /* g_file_set_contents() renames into place, so a concurrent
+   * reader never sees a half written catalog */
+  ret = g_file_set_contents (cache_path,
+                             (const gchar *) data->data,
+                             data->len,
+                             &error);
+
+  if (!ret)
+  {
+    g_warning ("Error writing applet catalog cache: %s", error->message);
+    g_error_free (error);
+  }
+
+  g_free (cache_dir);
+  g_free (cache_path);
+  g_free (locale);
+  g_hash_table_destroy (strings.offsets);
+  g_byte_array_free (strings.pool, TRUE);
+  g_byte_array_free (data, TRUE);
+
+  return ret;
+}
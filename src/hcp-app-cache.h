@@ -0,0 +1,55 @@
+/*
+ * This file is part of hildon-control-panel
+ *
+ * Copyright (C) 2010 Nokia Corporation.
+ *
+ * Contact: Karoliina Salminen <karoliina.t.salminen@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef HCP_APP_CACHE_H
+#define HCP_APP_CACHE_H
+
+#include <glib.h>
+
+#include "hcp-desktop-entry.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Binary catalog of the parsed applet .desktop files of one
+ * directory, stored under the user cache dir. The catalog is only
+ * valid for the directory, locale and apporder file it was written
+ * with; each record carries the stamp of its .desktop file, so the
+ * caller can decide which records are still usable.
+ *
+ * entries maps the .desktop basename to an HCPDesktopEntry.
+ */
+
+gboolean     hcp_app_cache_load      (const gchar        *dir_path,
+                                      const HCPFileStamp *pos_stamp,
+                                      HCPFileStamp       *dir_stamp,
+                                      GHashTable         *entries);
+
+gboolean     hcp_app_cache_save      (const gchar        *dir_path,
+                                      const HCPFileStamp *dir_stamp,
+                                      const HCPFileStamp *pos_stamp,
+                                      GHashTable         *entries);
+
+G_END_DECLS
+
+#endif
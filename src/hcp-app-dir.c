@@ -0,0 +1,414 @@
+/*
+ * This file is part of hildon-control-panel
+ *
+ * Copyright (C) 2010 Nokia Corporation.
+ *
+ * Contact: Karoliina Salminen <karoliina.t.salminen@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "hcp-app-dir.h"
+#include "hcp-app-cache.h"
+#include "hcp-desktop-entry.h"
+
+/* Below this, starting the parser threads costs more than parsing
+ * the files one after the other */
+#define HCP_APP_DIR_MIN_PARALLEL_JOBS 4
+
+static GKeyFile *
+hcp_app_dir_load_pos_keyfile (const gchar *dir_path)
+{
+  GKeyFile *pos_keyfile;
+  gchar *pos_path;
+
+  pos_keyfile = g_key_file_new ();
+  pos_path = g_strdup_printf ("%s/"HCP_APP_DIR_POS_REL_PATH, dir_path);
+
+  if (!g_key_file_load_from_file (pos_keyfile, pos_path, G_KEY_FILE_NONE, NULL))
+    g_debug ("no keyfile found or there was a problem while parsing %s", pos_path);
+
+  g_free (pos_path);
+
+  return pos_keyfile;
+}
+
+/* A .desktop file to be parsed by the worker threads */
+typedef struct {
+  const gchar     *dir_path;
+  gchar           *filename;
+  HCPFileStamp     stamp;
+  HCPDesktopEntry *entry;
+  GError          *error;
+} HCPParseJob;
+
+static void
+hcp_app_dir_queue_parse_job (GPtrArray          *jobs,
+                             const gchar        *dir_path,
+                             const gchar        *filename,
+                             const HCPFileStamp *stamp)
+{
+  HCPParseJob *job = g_new0 (HCPParseJob, 1);
+
+  job->dir_path = dir_path;
+  job->filename = g_strdup (filename);
+  job->stamp = *stamp;
+
+  g_ptr_array_add (jobs, job);
+}
+
+static void
+hcp_app_dir_free_parse_job (HCPParseJob *job)
+{
+  g_free (job->filename);
+
+  if (job->entry)
+    hcp_desktop_entry_free (job->entry);
+
+  if (job->error)
+    g_error_free (job->error);
+
+  g_free (job);
+}
+
+static gint
+hcp_app_dir_compare_parse_jobs (gconstpointer a, gconstpointer b)
+{
+  const HCPParseJob *job_a = *((const HCPParseJob **) a);
+  const HCPParseJob *job_b = *((const HCPParseJob **) b);
+
+  return strcmp (job_a->filename, job_b->filename);
+}
+
+/* Runs in a worker thread, only touches the job itself */
+static void
+hcp_app_dir_run_parse_job (HCPParseJob *job, gpointer user_data)
+{
+  job->entry = hcp_desktop_entry_load (job->dir_path,
+                                       job->filename,
+                                       &job->stamp,
+                                       NULL,
+                                       &job->error);
+}
+
+/* Parses the .desktop files of jobs and moves the results into
+ * entries. With parallel the files are parsed by a pool of threads
+ * the caller waits for, so it is not to be set on the main thread.
+ * Results are merged in filename order on the calling thread, so
+ * the outcome does not depend on scheduling. */
+static void
+hcp_app_dir_run_parse_jobs (const gchar *dir_path,
+                            GPtrArray   *jobs,
+                            GHashTable  *entries,
+                            gboolean     parallel)
+{
+  GThreadPool *pool = NULL;
+  GKeyFile *pos_keyfile = NULL;
+  guint i;
+
+  if (parallel && jobs->len >= HCP_APP_DIR_MIN_PARALLEL_JOBS)
+  {
+    GError *error = NULL;
+
+    pool = g_thread_pool_new ((GFunc) hcp_app_dir_run_parse_job,
+                              NULL,
+                              MIN ((guint) g_get_num_processors (), jobs->len),
+                              TRUE,
+                              &error);
+
+    if (error)
+    {
+      g_warning ("Error starting desktop file parser threads: %s",
+                 error->message);
+      g_error_free (error);
+    }
+  }
+
+  if (pool)
+  {
+    for (i = 0; i < jobs->len; i++)
+      g_thread_pool_push (pool, g_ptr_array_index (jobs, i), NULL);
+
+    /* Waits for all the queued jobs to finish */
+    g_thread_pool_free (pool, FALSE, TRUE);
+  }
+  else
+  {
+    for (i = 0; i < jobs->len; i++)
+      hcp_app_dir_run_parse_job (g_ptr_array_index (jobs, i), NULL);
+  }
+
+  g_ptr_array_sort (jobs, hcp_app_dir_compare_parse_jobs);
+
+  for (i = 0; i < jobs->len; i++)
+  {
+    HCPParseJob *job = g_ptr_array_index (jobs, i);
+
+    if (job->error)
+    {
+      g_warning ("Error reading applet desktop file: %s", job->error->message);
+      continue;
+    }
+
+    /* try to open keyfile with app positions, only once per scan */
+    if (pos_keyfile == NULL)
+      pos_keyfile = hcp_app_dir_load_pos_keyfile (dir_path);
+
+    hcp_desktop_entry_set_pos (job->entry, pos_keyfile);
+
+    g_hash_table_replace (entries, job->entry->filename, job->entry);
+    job->entry = NULL;
+  }
+
+  if (pos_keyfile)
+    g_key_file_free (pos_keyfile);
+}
+
+/* Takes the entry for filename from the catalog cache if the file
+ * did not change since, otherwise queues the .desktop file to be
+ * parsed again. Returns TRUE if the cache is out of date. */
+static gboolean
+hcp_app_dir_get_desktop_entry (const gchar  *dir_path,
+                               const gchar  *filename,
+                               GHashTable   *cached,
+                               GHashTable   *entries,
+                               GPtrArray    *jobs)
+{
+  HCPDesktopEntry *entry;
+  HCPFileStamp stamp;
+  gchar *desktop_path;
+  gboolean exists;
+
+  desktop_path = g_build_filename (dir_path, filename, NULL);
+  exists = hcp_file_stamp_get (desktop_path, &stamp);
+  g_free (desktop_path);
+
+  /* Removed since the cache was written */
+  if (!exists)
+    return TRUE;
+
+  entry = g_hash_table_lookup (cached, filename);
+
+  if (entry && hcp_file_stamp_equal (&entry->stamp, &stamp))
+  {
+    g_hash_table_steal (cached, filename);
+    g_hash_table_replace (entries, entry->filename, entry);
+
+    return FALSE;
+  }
+
+  hcp_app_dir_queue_parse_job (jobs, dir_path, filename, &stamp);
+
+  return TRUE;
+}
+
+static void
+hcp_app_dir_save_cache (HCPAppDir *dir)
+{
+  HCPFileStamp dir_stamp;
+
+  if (!hcp_file_stamp_get (dir->path, &dir_stamp))
+    return;
+
+  hcp_app_cache_save (dir->path,
+                      &dir_stamp,
+                      &dir->pos_stamp,
+                      dir->entries);
+}
+
+/* Reads all the .desktop files of dir, going through the catalog
+ * cache for the ones which did not change. parallel spreads the
+ * files to parse over several threads, for callers which are not on
+ * the main thread. */
+void
+hcp_app_dir_read (HCPAppDir *dir, gboolean parallel)
+{
+  const gchar *dir_path;
+  GHashTable *cached;
+  GPtrArray *jobs;
+  gchar *pos_path = NULL;
+  HCPFileStamp dir_stamp, cache_dir_stamp;
+  gboolean dirty = FALSE;
+
+  g_return_if_fail (dir);
+
+  dir_path = dir->path;
+
+  g_hash_table_remove_all (dir->entries);
+
+  if (!hcp_file_stamp_get (dir_path, &dir_stamp))
+  {
+    /* Overlays only exist when something was installed in them */
+    if (!dir->optional)
+      g_warning ("Error reading desktop files directory: %s", dir_path);
+
+    return;
+  }
+
+  pos_path = g_strdup_printf ("%s/"HCP_APP_DIR_POS_REL_PATH, dir_path);
+
+  /* Zeroes if there is none */
+  hcp_file_stamp_get (pos_path, &dir->pos_stamp);
+
+  g_free (pos_path);
+
+  cached = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                  (GDestroyNotify) hcp_desktop_entry_free);
+
+  jobs = g_ptr_array_new ();
+
+  if (hcp_app_cache_load (dir_path, &dir->pos_stamp, &cache_dir_stamp, cached) &&
+      hcp_file_stamp_equal (&cache_dir_stamp, &dir_stamp))
+  {
+    GList *filenames, *l;
+
+    /* No file was added or removed, only check the cached ones */
+    filenames = g_hash_table_get_keys (cached);
+
+    for (l = filenames; l; l = l->next)
+    {
+      dirty |= hcp_app_dir_get_desktop_entry (dir_path, l->data,
+                                              cached, dir->entries,
+                                              jobs);
+    }
+
+    g_list_free (filenames);
+  }
+  else
+  {
+    GDir *gdir;
+    GError *error = NULL;
+    const char *filename;
+
+    gdir = g_dir_open (dir_path, 0, &error);
+
+    if (!gdir)
+    {
+      g_warning ("Error reading desktop files directory: %s", error->message);
+      g_error_free (error);
+      goto cleanup;
+    }
+
+    while ((filename = g_dir_read_name (gdir)))
+    {
+      /* Only consider .desktop files */
+      if (!g_str_has_suffix (filename, ".desktop"))
+        continue;
+
+      hcp_app_dir_get_desktop_entry (dir_path, filename,
+                                     cached, dir->entries,
+                                     jobs);
+    }
+
+    g_dir_close (gdir);
+
+    dirty = TRUE;
+  }
+
+  hcp_app_dir_run_parse_jobs (dir_path, jobs, dir->entries, parallel);
+
+  if (dirty)
+    hcp_app_cache_save (dir_path, &dir_stamp, &dir->pos_stamp, dir->entries);
+
+cleanup:
+  g_ptr_array_foreach (jobs, (GFunc) hcp_app_dir_free_parse_job, NULL);
+  g_ptr_array_free (jobs, TRUE);
+
+  g_hash_table_destroy (cached);
+}
+
+/* Re-reads the .desktop files in filenames (a set of basenames),
+ * dropping the ones which were deleted. Runs on the main thread for
+ * the monitor events, usually for a file or two, so they are parsed
+ * right there. */
+void
+hcp_app_dir_update (HCPAppDir *dir, GHashTable *filenames)
+{
+  GHashTableIter iter;
+  GPtrArray *jobs;
+  gpointer filename;
+
+  g_return_if_fail (dir);
+  g_return_if_fail (filenames);
+
+  jobs = g_ptr_array_new ();
+
+  g_hash_table_iter_init (&iter, filenames);
+
+  while (g_hash_table_iter_next (&iter, &filename, NULL))
+  {
+    HCPFileStamp stamp;
+    gchar *desktop_path;
+    gboolean exists;
+
+    g_hash_table_remove (dir->entries, filename);
+
+    desktop_path = g_build_filename (dir->path, filename, NULL);
+    exists = hcp_file_stamp_get (desktop_path, &stamp);
+    g_free (desktop_path);
+
+    /* Deleted */
+    if (!exists)
+      continue;
+
+    hcp_app_dir_queue_parse_job (jobs, dir->path, filename, &stamp);
+  }
+
+  hcp_app_dir_run_parse_jobs (dir->path, jobs, dir->entries, FALSE);
+
+  g_ptr_array_foreach (jobs, (GFunc) hcp_app_dir_free_parse_job, NULL);
+  g_ptr_array_free (jobs, TRUE);
+
+  hcp_app_dir_save_cache (dir);
+}
+
+HCPAppDir *
+hcp_app_dir_new (const gchar *path, gboolean optional)
+{
+  HCPAppDir *dir;
+
+  g_return_val_if_fail (path, NULL);
+
+  dir = g_new0 (HCPAppDir, 1);
+
+  dir->path = g_strdup (path);
+  dir->optional = optional;
+  dir->entries = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                        (GDestroyNotify) hcp_desktop_entry_free);
+  memset (&dir->pos_stamp, 0, sizeof (HCPFileStamp));
+
+  return dir;
+}
+
+void
+hcp_app_dir_free (HCPAppDir *dir)
+{
+  if (!dir)
+    return;
+
+  g_hash_table_destroy (dir->entries);
+  g_free (dir->path);
+
+  g_free (dir);
+}
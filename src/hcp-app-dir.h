@@ -0,0 +1,59 @@
+/*
+ * This file is part of hildon-control-panel
+ *
+ * Copyright (C) 2010 Nokia Corporation.
+ *
+ * Contact: Karoliina Salminen <karoliina.t.salminen@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef HCP_APP_DIR_H
+#define HCP_APP_DIR_H
+
+#include <glib.h>
+
+#include "hcp-desktop-entry.h"
+
+G_BEGIN_DECLS
+
+/* Subdirectory holding the applet positions of a directory, and
+ * the positions file in it */
+#define HCP_APP_DIR_POS_REL_DIR  "apporder"
+#define HCP_APP_DIR_POS_REL_PATH HCP_APP_DIR_POS_REL_DIR"/applets.desktop"
+
+/* One directory of applet .desktop files in the search path. */
+typedef struct _HCPAppDir {
+  gchar        *path;
+  gboolean      optional;   /* no warning if it does not exist */
+  GHashTable   *entries;    /* basename -> HCPDesktopEntry */
+  HCPFileStamp  pos_stamp;  /* of apporder/applets.desktop, zeroes if none */
+} HCPAppDir;
+
+HCPAppDir*   hcp_app_dir_new      (const gchar *path,
+                                   gboolean     optional);
+
+void         hcp_app_dir_read     (HCPAppDir   *dir,
+                                   gboolean     parallel);
+
+void         hcp_app_dir_update   (HCPAppDir   *dir,
+                                   GHashTable  *filenames);
+
+void         hcp_app_dir_free     (HCPAppDir   *dir);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,298 @@
+/*
+ * This file is part of hildon-control-panel
+ *
+ * Copyright (C) 2010 Nokia Corporation.
+ *
+ * Contact: Karoliina Salminen <karoliina.t.salminen@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+
+/*
+ * Counts the allocations made by a full rescan of the applet
+ * directories (hcp_app_list_update ()), and those of building and
+ * reading HCPApps through GObject properties, as the list used to,
+ * against hcp_app_new_full () and the hcp_app_peek_* () accessors.
+ *
+ * The rescan "before" is the same rescan followed by what the list
+ * did for every shown applet until hcp_app_new_full () and the
+ * accessors: a new HCPApp set up with g_object_set (), and its
+ * category read with g_object_get () to place it.
+ *
+ * malloc (), calloc () and realloc () are replaced in the program
+ * itself, so the calls glib makes are counted too without any
+ * LD_PRELOAD; g_mem_set_vtable () does nothing in current glib.
+ * Needs glibc. The applets are read from the installed directories.
+ *
+ * Usage: hcp-app-list-bench [ROUNDS]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include <glib.h>
+#include <glib-object.h>
+
+#include "hcp-app.h"
+#include "hcp-app-list.h"
+
+#define HCP_BENCH_ROUNDS 100
+
+static gint hcp_bench_counting = 0;
+static gint hcp_bench_allocs = 0;
+
+#ifdef __GLIBC__
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+void *
+malloc (size_t size)
+{
+  if (hcp_bench_counting)
+    g_atomic_int_inc (&hcp_bench_allocs);
+
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t n, size_t size)
+{
+  if (hcp_bench_counting)
+    g_atomic_int_inc (&hcp_bench_allocs);
+
+  return __libc_calloc (n, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+  if (hcp_bench_counting)
+    g_atomic_int_inc (&hcp_bench_allocs);
+
+  return __libc_realloc (ptr, size);
+}
+
+#endif
+
+static void
+hcp_bench_start (void)
+{
+  g_atomic_int_set (&hcp_bench_allocs, 0);
+  g_atomic_int_set (&hcp_bench_counting, 1);
+}
+
+static guint
+hcp_bench_stop (void)
+{
+  g_atomic_int_set (&hcp_bench_counting, 0);
+
+  return (guint) g_atomic_int_get (&hcp_bench_allocs);
+}
+
+/* What the list did for each applet before hcp_app_new_full () */
+static GObject *
+hcp_bench_new_app_with_properties (HCPApp *app, gint pos)
+{
+  GObject *copy = hcp_app_new ();
+
+  g_object_set (copy,
+                "name", hcp_app_peek_name (app),
+                "plugin", hcp_app_peek_plugin (app),
+                "icon", hcp_app_peek_icon (app),
+                NULL);
+
+  if (hcp_app_peek_category (app) != NULL)
+    g_object_set (copy, "category", hcp_app_peek_category (app), NULL);
+
+  if (hcp_app_peek_text_domain (app) != NULL)
+    g_object_set (copy, "text-domain", hcp_app_peek_text_domain (app), NULL);
+
+  if (pos != G_MAXINT)
+    g_object_set (copy, "suggested-pos", pos, NULL);
+
+  return copy;
+}
+
+/* The fields the list, the window and the grid read from each app */
+static void
+hcp_bench_read_with_properties (HCPApp *app)
+{
+  gchar *name = NULL, *plugin = NULL, *icon = NULL, *category = NULL;
+
+  g_object_get (G_OBJECT (app),
+                "name", &name,
+                "plugin", &plugin,
+                "icon", &icon,
+                "category", &category,
+                NULL);
+
+  g_free (name);
+  g_free (plugin);
+  g_free (icon);
+  g_free (category);
+}
+
+static void
+hcp_bench_read_with_peek (HCPApp *app)
+{
+  hcp_app_peek_name (app);
+  hcp_app_peek_plugin (app);
+  hcp_app_peek_icon (app);
+  hcp_app_peek_category (app);
+}
+
+/* One rescan the way it used to go, see above */
+static guint
+hcp_bench_rescan_with_properties (HCPAppList *al)
+{
+  GHashTable *apps = NULL;
+  GHashTableIter iter;
+  gpointer value;
+  guint allocs;
+
+  hcp_bench_start ();
+  hcp_app_list_update (al);
+  allocs = hcp_bench_stop ();
+
+  g_object_get (G_OBJECT (al), "apps", &apps, NULL);
+
+  g_hash_table_iter_init (&iter, apps);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+  {
+    HCPApp *app = HCP_APP (value);
+    GObject *copy;
+    gchar *category = NULL;
+    gint pos = G_MAXINT;
+
+    g_object_get (G_OBJECT (app), "suggested-pos", &pos, NULL);
+
+    hcp_bench_start ();
+
+    copy = hcp_bench_new_app_with_properties (app, pos);
+    g_object_get (copy, "category", &category, NULL);
+    g_free (category);
+
+    allocs += hcp_bench_stop ();
+
+    g_object_unref (copy);
+  }
+
+  return allocs;
+}
+
+int
+main (int argc, char **argv)
+{
+  HCPAppList *al;
+  GHashTable *apps = NULL;
+  GHashTableIter iter;
+  gpointer value;
+  guint rounds = HCP_BENCH_ROUNDS;
+  guint first, rescan, rescan_before, n_apps;
+  guint set_allocs = 0, full_allocs = 0, get_allocs = 0, peek_allocs = 0;
+  guint i;
+
+#ifndef __GLIBC__
+  g_printerr ("Allocations can only be counted with glibc\n");
+  return 77;
+#endif
+
+  if (argc > 1)
+    rounds = MAX (1, atoi (argv[1]));
+
+#if !GLIB_CHECK_VERSION (2, 36, 0)
+  g_type_init ();
+#endif
+
+  al = HCP_APP_LIST (hcp_app_list_new ());
+
+  /* Includes reading the categories from GConf */
+  hcp_bench_start ();
+  hcp_app_list_update (al);
+  first = hcp_bench_stop ();
+
+  hcp_bench_start ();
+
+  for (i = 0; i < rounds; i++)
+    hcp_app_list_update (al);
+
+  rescan = hcp_bench_stop () / rounds;
+
+  rescan_before = 0;
+
+  for (i = 0; i < rounds; i++)
+    rescan_before += hcp_bench_rescan_with_properties (al);
+
+  rescan_before /= rounds;
+
+  g_object_get (G_OBJECT (al), "apps", &apps, NULL);
+
+  n_apps = g_hash_table_size (apps);
+
+  g_hash_table_iter_init (&iter, apps);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+  {
+    HCPApp *app = HCP_APP (value);
+    GObject *copy;
+    gint pos = G_MAXINT;
+
+    g_object_get (G_OBJECT (app), "suggested-pos", &pos, NULL);
+
+    hcp_bench_start ();
+    copy = hcp_bench_new_app_with_properties (app, pos);
+    set_allocs += hcp_bench_stop ();
+    g_object_unref (copy);
+
+    hcp_bench_start ();
+    copy = hcp_app_new_full (hcp_app_peek_name (app),
+                             hcp_app_peek_plugin (app),
+                             hcp_app_peek_icon (app),
+                             hcp_app_peek_category (app),
+                             hcp_app_peek_text_domain (app),
+                             pos);
+    full_allocs += hcp_bench_stop ();
+    g_object_unref (copy);
+
+    hcp_bench_start ();
+    hcp_bench_read_with_properties (app);
+    get_allocs += hcp_bench_stop ();
+
+    hcp_bench_start ();
+    hcp_bench_read_with_peek (app);
+    peek_allocs += hcp_bench_stop ();
+  }
+
+  g_print ("%u applets shown\n", n_apps);
+  g_print ("first update:        %u allocations\n", first);
+  g_print ("rescan, before:      %u allocations (mean of %u)\n", rescan_before, rounds);
+  g_print ("rescan, after:       %u allocations (mean of %u)\n", rescan, rounds);
+  g_print ("new apps, before:    %u allocations (g_object_set)\n", set_allocs);
+  g_print ("new apps, after:     %u allocations (hcp_app_new_full)\n", full_allocs);
+  g_print ("read fields, before: %u allocations (g_object_get)\n", get_allocs);
+  g_print ("read fields, after:  %u allocations (hcp_app_peek_*)\n", peek_allocs);
+
+  g_object_unref (al);
+
+  return 0;
+}
@@ -33,11 +33,16 @@
 #include <gtk/gtk.h>
 #include <gconf/gconf-client.h>
 #include <glib/gi18n.h>
-#include <dbus/dbus-glib.h>
 
 #include "hcp-app-list.h"
 #include "hcp-app.h"
+#include "hcp-app-dir.h"
+#include "hcp-debouncer.h"
+#include "hcp-sys-info.h"
+#include "hcp-desktop-entry.h"
 #include "hcp-config-keys.h"
+#include "hcp-marshalers.h"
+#include "hcp-trace.h"
 
 #define HCP_APP_LIST_GET_PRIVATE(object) \
         (G_TYPE_INSTANCE_GET_PRIVATE ((object), HCP_TYPE_APP_LIST, HCPAppListPrivate))
@@ -47,6 +52,7 @@ G_DEFINE_TYPE (HCPAppList, hcp_app_list, G_TYPE_OBJECT);
 typedef enum
 {
   SIGNAL_UPDATED,
+  SIGNAL_APPS_CHANGED,
   N_SIGNALS
 } HCPAppListSignals;
 
@@ -57,37 +63,387 @@ enum
   PROP_0,
   PROP_APPS,
   PROP_CATEGORIES,
+  PROP_CATEGORY_INDEX,
+  PROP_GENERATION,
+  PROP_EVENTS_RECEIVED,
+  PROP_UPDATES
 };
 
-struct _HCPAppListPrivate 
+/* The apps and categories readers see. A full update builds a new
+ * generation next to the current one and swaps it in at once, so
+ * readers never see a partial list. */
+typedef struct
 {
+  guint         serial;
+
   GHashTable   *apps;
   GSList       *categories;
-  GFileMonitor *monitor;
+
+  /* plugin -> HCPDesktopEntry its app was made from. When several
+   * .desktop files name the same plugin, the first one in filename
+   * order provides the app and the others wait until it goes away. */
+  GHashTable   *owners;
+
+  /* The same categories, for lookups by index */
+  GPtrArray    *category_array;
+
+  /* Category id -> HCPCategory, ignoring ASCII case; the default
+   * category is the last one of categories */
+  GHashTable   *category_index;
+  HCPCategory  *default_category;
+
+  /* HCPApp -> GSequenceIter of the app in its category */
+  GHashTable   *sorted_apps;
+} HCPAppListGeneration;
+
+struct _HCPAppListPrivate 
+{
+  HCPAppListGeneration *gen;
+
+  /* plugin -> HCPApp removed during the current update, reused if
+   * the plugin comes back, so running and loaded applets keep their
+   * state */
+  GHashTable   *retired;
+
+  /* HCPApp whose name or icon changed during the current update */
+  GHashTable   *modified;
+
+  /* HCPAppListLayer, in increasing priority */
+  GPtrArray    *layers;
+
+  /* .desktop basename -> HCPDesktopEntry of the layer it is taken
+   * from, the entries are owned by the layers */
+  GHashTable   *entries;
+
+  /* Hardware capabilities some applets depend on */
+  HCPSysInfo   *sys_info;
+
+  /* Worker reading the directories for the first update, and
+   * whether they were read for the next update */
+  GThread      *reader;
+  gboolean      dirs_read;
 };
 
+/* One directory of the applet search path, with its own monitor.
+ * An entry of a layer hides the entries with the same basename in
+ * the layers before it. */
+typedef struct
+{
+  HCPAppList   *al;
+  HCPAppDir    *dir;
+  GFile        *file;
+  GFileMonitor *monitor;
+
+  /* The directory monitor only reports apporder itself, not the
+   * positions file in it */
+  GFileMonitor *pos_monitor;
+
+  /* Coalesces monitor events into update batches */
+  HCPDebouncer *debouncer;
+} HCPAppListLayer;
+
 #define HCP_SEPARATOR_DEFAULT _("copa_ia_extras")
 
-/* Delay to wait from callback to actually reading 
- * the entries in msecs */
-#define HCP_DIR_READ_DELAY 500
+/* Applets installed by the user, under $XDG_DATA_HOME */
+#define HCP_USER_ENTRY_REL_DIR "applications/hildon-control-panel"
+
+/* Quiet period after the last monitor event before the changed
+ * entries are read, and how long a burst of events (e.g. a dpkg run
+ * installing several applets) may postpone that, in msecs */
+#define HCP_UPDATE_QUIET_MIN     250
+#define HCP_UPDATE_QUIET_MAX     2000
+#define HCP_UPDATE_MAX_LATENCY   5000
+
+/* Queued when the directory itself appears or goes away */
+#define HCP_LAYER_RELOAD "."
+
+static void hcp_app_list_update_layer (HCPAppList      *al,
+                                       HCPAppListLayer *layer,
+                                       GHashTable      *filenames);
+static void hcp_app_list_reload_layer (HCPAppList      *al,
+                                       HCPAppListLayer *layer);
+static void hcp_app_list_sys_info_changed_cb (HCPSysInfo  *info,
+                                              HCPAppList  *al);
+static gboolean hcp_app_list_apply_locale (HCPAppList *al);
+
+/* The apps of every category in order, holding a reference on them
+ * so that removed apps can still be reported */
+static GPtrArray *
+hcp_app_list_snapshot (HCPAppList *al)
+{
+  GPtrArray *snapshot = g_ptr_array_new ();
+  GSList *l;
+
+  for (l = al->priv->gen->categories; l; l = l->next)
+  {
+    HCPCategory *category = (HCPCategory *) l->data;
+    GSequenceIter *iter;
+    GPtrArray *apps;
+
+    apps = g_ptr_array_sized_new (g_sequence_get_length (category->apps));
+
+    for (iter = g_sequence_get_begin_iter (category->apps);
+         !g_sequence_iter_is_end (iter);
+         iter = g_sequence_iter_next (iter))
+      g_ptr_array_add (apps, g_object_ref (g_sequence_get (iter)));
+
+    g_ptr_array_add (snapshot, apps);
+  }
+
+  return snapshot;
+}
+
+static void
+hcp_app_list_free_snapshot (GPtrArray *snapshot)
+{
+  guint i;
+
+  for (i = 0; i < snapshot->len; i++)
+  {
+    GPtrArray *apps = g_ptr_array_index (snapshot, i);
+
+    g_ptr_array_foreach (apps, (GFunc) g_object_unref, NULL);
+    g_ptr_array_free (apps, TRUE);
+  }
+
+  g_ptr_array_free (snapshot, TRUE);
+}
+
+static void
+hcp_app_list_add_change (GArray           *changes,
+                         HCPAppChangeType  type,
+                         gpointer          app,
+                         guint             category,
+                         guint             position,
+                         guint             old_position)
+{
+  HCPAppChange change;
+
+  change.type = type;
+  change.app = HCP_APP (app);
+  change.category = category;
+  change.position = position;
+  change.old_position = old_position;
+
+  g_array_append_val (changes, change);
+}
+
+static GHashTable *
+hcp_app_list_new_app_set (GPtrArray *apps)
+{
+  GHashTable *set = g_hash_table_new (g_direct_hash, g_direct_equal);
+  guint i;
+
+  for (i = 0; i < apps->len; i++)
+    g_hash_table_insert (set, g_ptr_array_index (apps, i),
+                         g_ptr_array_index (apps, i));
+
+  return set;
+}
+
+/* Appends the steps turning before into after, see HCPAppChange */
+static void
+hcp_app_list_diff_category (HCPAppList *al,
+                            GArray     *changes,
+                            guint       category,
+                            GPtrArray  *before,
+                            GPtrArray  *after)
+{
+  GHashTable *in_before, *in_after;
+  GPtrArray *current;
+  guint i;
+
+  in_before = hcp_app_list_new_app_set (before);
+  in_after = hcp_app_list_new_app_set (after);
+
+  current = g_ptr_array_sized_new (after->len);
+
+  /* From the end, so the positions of the next ones stay valid */
+  for (i = before->len; i > 0; i--)
+  {
+    gpointer app = g_ptr_array_index (before, i - 1);
+
+    if (!g_hash_table_lookup (in_after, app))
+      hcp_app_list_add_change (changes, HCP_APP_CHANGE_REMOVED,
+                               app, category, i - 1, i - 1);
+  }
+
+  for (i = 0; i < before->len; i++)
+  {
+    gpointer app = g_ptr_array_index (before, i);
+
+    if (g_hash_table_lookup (in_after, app))
+      g_ptr_array_add (current, app);
+  }
+
+  for (i = 0; i < after->len; i++)
+  {
+    gpointer app = g_ptr_array_index (after, i);
+
+    if (i < current->len && g_ptr_array_index (current, i) == app)
+      continue;
+
+    if (g_hash_table_lookup (in_before, app))
+    {
+      guint old_position = i + 1;
+
+      /* Apps before i are in place already */
+      while (g_ptr_array_index (current, old_position) != app)
+        old_position++;
+
+      g_ptr_array_remove_index (current, old_position);
+      hcp_app_list_add_change (changes, HCP_APP_CHANGE_MOVED,
+                               app, category, i, old_position);
+    }
+    else
+    {
+      hcp_app_list_add_change (changes, HCP_APP_CHANGE_ADDED,
+                               app, category, i, i);
+    }
+
+    /* Insert at i */
+    g_ptr_array_add (current, NULL);
+    memmove (&current->pdata[i + 1], &current->pdata[i],
+             (current->len - i - 1) * sizeof (gpointer));
+    current->pdata[i] = app;
+  }
+
+  for (i = 0; i < after->len; i++)
+  {
+    gpointer app = g_ptr_array_index (after, i);
+
+    if (g_hash_table_lookup (in_before, app) &&
+        g_hash_table_lookup (al->priv->modified, app))
+      hcp_app_list_add_change (changes, HCP_APP_CHANGE_MODIFIED,
+                               app, category, i, i);
+  }
+
+  g_ptr_array_free (current, TRUE);
+  g_hash_table_destroy (in_after);
+  g_hash_table_destroy (in_before);
+}
+
+/* Emits "apps-changed" with what changed since the before snapshot,
+ * which is freed */
+static void
+hcp_app_list_emit_changes (HCPAppList *al, GPtrArray *before)
+{
+  GPtrArray *after;
+  GArray *changes;
+  guint i;
+
+  after = hcp_app_list_snapshot (al);
+  changes = g_array_new (FALSE, FALSE, sizeof (HCPAppChange));
+
+  /* All generations have the same categories */
+  for (i = 0; i < MIN (before->len, after->len); i++)
+    hcp_app_list_diff_category (al, changes, i,
+                                g_ptr_array_index (before, i),
+                                g_ptr_array_index (after, i));
 
-#define HCP_POS_REL_PATH "apporder/applets.desktop"
-static int callback_pending = 0;
+  g_hash_table_remove_all (al->priv->modified);
 
-static gboolean 
-hcp_monitor_reread_desktop_entries (HCPAppList *al)
+  if (changes->len > 0)
+    g_signal_emit (G_OBJECT (al),
+                   signals[SIGNAL_APPS_CHANGED],
+                   0, al->priv->gen->serial, changes);
+
+  g_array_free (changes, TRUE);
+
+  hcp_app_list_free_snapshot (after);
+  hcp_app_list_free_snapshot (before);
+}
+
+static void
+hcp_app_list_debouncer_flush_cb (HCPDebouncer    *debouncer,
+                                 GHashTable      *paths,
+                                 HCPAppListLayer *layer)
 {
-  callback_pending = 0;
+  GPtrArray *before;
+
+  /* The directories are not ours while the reader runs */
+  if (layer->al->priv->reader)
+    hcp_app_list_update (layer->al);
+
+  before = hcp_app_list_snapshot (layer->al);
+
+  hcp_app_list_apply_locale (layer->al);
 
-  /* Re-read the item list from .desktop files */
-  hcp_app_list_update (al);
+  if (g_hash_table_lookup (paths, HCP_APP_DIR_POS_REL_DIR) ||
+      g_hash_table_lookup (paths, HCP_LAYER_RELOAD))
+  {
+    /* Positions of any applet may have changed, 
+     * re-read the item list of this directory */
+    hcp_app_list_reload_layer (layer->al, layer);
+  }
+  else
+  {
+    /* Only the files we were told about */
+    hcp_app_list_update_layer (layer->al, layer, paths);
+  }
+
+  hcp_app_list_emit_changes (layer->al, before);
 
-  g_signal_emit (G_OBJECT (al), 
+  g_signal_emit (G_OBJECT (layer->al), 
                  signals[SIGNAL_UPDATED], 
                  0, NULL);
+}
+
+static void 
+hcp_pos_monitor_callback_f (GFileMonitor      *monitor,
+                            GFile             *file,
+                            GFile             *other_file,
+                            GFileMonitorEvent  event_type,
+                            HCPAppListLayer   *layer)
+{
+  switch (event_type)
+  {
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+    case G_FILE_MONITOR_EVENT_DELETED:
+      /* Reloads the whole layer, see the flush */
+      hcp_debouncer_queue (layer->debouncer, HCP_APP_DIR_POS_REL_DIR);
+      break;
+
+    default:
+      break;
+  }
+}
+
+/* Made again whenever apporder or the layer directory appears, so
+ * that the monitor watches the file of the new directory */
+static void
+hcp_init_pos_monitor (HCPAppListLayer *layer)
+{
+  GError *error = NULL;
+  GFile *pos_file;
+
+  if (layer->pos_monitor)
+  {
+    g_file_monitor_cancel (layer->pos_monitor);
+    g_object_unref (layer->pos_monitor);
+    layer->pos_monitor = NULL;
+  }
 
-  return FALSE; 
+  pos_file = g_file_resolve_relative_path (layer->file,
+                                           HCP_APP_DIR_POS_REL_PATH);
+
+  layer->pos_monitor = g_file_monitor_file (pos_file,
+                                            G_FILE_MONITOR_NONE,
+                                            NULL,
+                                            &error);
+  g_object_unref (pos_file);
+
+  if (error != NULL) {
+    g_warning ("Unable to monitor %s/%s: %s",
+               layer->dir->path, HCP_APP_DIR_POS_REL_PATH, error->message);
+    g_error_free (error);
+    return;
+  }
+
+  g_signal_connect (layer->pos_monitor, "changed",
+                    G_CALLBACK (hcp_pos_monitor_callback_f),
+                    layer);
 }
 
 static void 
@@ -95,48 +451,203 @@ hcp_monitor_callback_f (GFileMonitor *monitor,
                         GFile *file,
                         GFile *other_file,
                         GFileMonitorEvent event_type,
-                        HCPAppList *al)
+                        HCPAppListLayer *layer)
 {
-  if (!callback_pending) 
+  gchar *basename;
+
+  switch (event_type)
   {
-    callback_pending = 1;
-    g_timeout_add (HCP_DIR_READ_DELAY,
-                  (GSourceFunc) hcp_monitor_reread_desktop_entries, al);
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_CHANGED:
+    case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+    case G_FILE_MONITOR_EVENT_DELETED:
+      break;
+
+    default:
+      return;
+  }
+
+  if (g_file_equal (file, layer->file))
+  {
+    if (event_type == G_FILE_MONITOR_EVENT_CREATED)
+      hcp_init_pos_monitor (layer);
+
+    hcp_debouncer_queue (layer->debouncer, HCP_LAYER_RELOAD);
+    return;
   }
+
+  basename = g_file_get_basename (file);
+
+  if (!strcmp (basename, HCP_APP_DIR_POS_REL_DIR))
+  {
+    if (event_type == G_FILE_MONITOR_EVENT_CREATED)
+      hcp_init_pos_monitor (layer);
+
+    hcp_debouncer_queue (layer->debouncer, basename);
+  }
+  else if (g_str_has_suffix (basename, ".desktop"))
+  {
+    hcp_debouncer_queue (layer->debouncer, basename);
+  }
+
+  g_free (basename);
 }
 
 static void 
-hcp_init_monitor (HCPAppList *al, GFile *directory)
+hcp_init_monitor (HCPAppListLayer *layer)
 {
-  GFileMonitor *monitor = NULL;
   GError *error = NULL;
 
-  al->priv->monitor = g_file_monitor_directory (directory,
-                                                G_FILE_MONITOR_NONE,
-                                                NULL,
-                                                &error);
+  layer->monitor = g_file_monitor_directory (layer->file,
+                                             G_FILE_MONITOR_NONE,
+                                             NULL,
+                                             &error);
   if (error != NULL) {
-    gchar *path;
-
-    path = g_file_get_parse_name (directory);
     g_warning ("Unable to monitor directory %s: %s",
-               path, error->message);
+               layer->dir->path, error->message);
     g_error_free (error);
-    g_free (path);
     return;
   }
 
-  if (monitor != NULL) {
-  g_signal_connect (monitor, "changed",
+  g_signal_connect (layer->monitor, "changed",
                     G_CALLBACK (hcp_monitor_callback_f),
-                    al);
+                    layer);
+
+  hcp_init_pos_monitor (layer);
+}
+
+static void
+hcp_app_list_add_layer (HCPAppList *al, const gchar *path, gboolean optional)
+{
+  HCPAppListLayer *layer = g_new0 (HCPAppListLayer, 1);
+
+  layer->al = al;
+  layer->dir = hcp_app_dir_new (path, optional);
+  layer->file = g_file_new_for_path (path);
+
+  layer->debouncer = hcp_debouncer_new (HCP_UPDATE_QUIET_MIN,
+                                        HCP_UPDATE_QUIET_MAX,
+                                        HCP_UPDATE_MAX_LATENCY);
+
+  g_signal_connect (layer->debouncer, "flush",
+                    G_CALLBACK (hcp_app_list_debouncer_flush_cb),
+                    layer);
+
+  hcp_init_monitor (layer);
+
+  g_ptr_array_add (al->priv->layers, layer);
+}
+
+static void
+hcp_app_list_free_layer (HCPAppListLayer *layer)
+{
+  if (layer->monitor)
+  {
+    g_file_monitor_cancel (layer->monitor);
+    g_object_unref (layer->monitor);
+  }
+
+  if (layer->pos_monitor)
+  {
+    g_file_monitor_cancel (layer->pos_monitor);
+    g_object_unref (layer->pos_monitor);
+  }
+
+  hcp_debouncer_cancel (layer->debouncer);
+  g_signal_handlers_disconnect_by_func (layer->debouncer,
+                                        hcp_app_list_debouncer_flush_cb,
+                                        layer);
+  g_object_unref (layer->debouncer);
+
+  g_object_unref (layer->file);
+  hcp_app_dir_free (layer->dir);
+
+  g_free (layer);
+}
+
+/* Case insensitive versions of g_str_hash and g_str_equal, category
+ * ids from GConf and .desktop files do not always agree on case */
+static guint
+hcp_app_list_category_hash (gconstpointer key)
+{
+  const gchar *p;
+  guint hash = 5381;
+
+  for (p = key; *p != '\0'; p++)
+    hash = (hash << 5) + hash + g_ascii_tolower (*p);
+
+  return hash;
+}
+
+static gboolean
+hcp_app_list_category_equal (gconstpointer a, gconstpointer b)
+{
+  return g_ascii_strcasecmp (a, b) == 0;
+}
+
+static void
+hcp_app_list_add_category (HCPAppListGeneration *gen, HCPCategory *category)
+{
+  category->apps = g_sequence_new (NULL);
+
+  gen->categories = g_slist_append (gen->categories, category);
+  g_ptr_array_add (gen->category_array, category);
+
+  /* The first category with a given id gets the apps */
+  if (category->id &&
+      !g_hash_table_lookup (gen->category_index, category->id))
+    g_hash_table_insert (gen->category_index, category->id, category);
+}
+
+static HCPAppListGeneration *
+hcp_app_list_generation_new (guint serial)
+{
+  HCPAppListGeneration *gen = g_new0 (HCPAppListGeneration, 1);
+
+  gen->serial = serial;
+  gen->apps = g_hash_table_new (g_str_hash, g_str_equal);
+  gen->owners = g_hash_table_new (g_direct_hash, g_direct_equal);
+  gen->categories = NULL;
+  gen->category_array = g_ptr_array_new ();
+  gen->category_index = g_hash_table_new (hcp_app_list_category_hash,
+                                          hcp_app_list_category_equal);
+  gen->default_category = NULL;
+  gen->sorted_apps = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  return gen;
+}
+
+/* An empty generation following gen, with the same categories */
+static HCPAppListGeneration *
+hcp_app_list_generation_next (HCPAppListGeneration *gen)
+{
+  HCPAppListGeneration *next;
+  GSList *l;
+
+  next = hcp_app_list_generation_new (gen->serial + 1);
+
+  for (l = gen->categories; l; l = l->next)
+  {
+    HCPCategory *category = (HCPCategory *) l->data;
+    HCPCategory *copy = g_new0 (HCPCategory, 1);
+
+    copy->id = g_strdup (category->id);
+    copy->name = g_strdup (category->name);
+
+    hcp_app_list_add_category (next, copy);
+
+    if (category == gen->default_category)
+      next->default_category = copy;
   }
+
+  return next;
 }
 
+/* GConf clients are not thread safe, to be called on the main
+ * thread */
 static void
 hcp_app_list_get_configured_categories (HCPAppList *al)
 {
-  HCPAppListPrivate *priv;
   GConfClient *client = NULL;
   GSList *group_names = NULL;
   GSList *group_names_i = NULL;
@@ -147,7 +658,7 @@ hcp_app_list_get_configured_categories (HCPAppList *al)
   g_return_if_fail (al);
   g_return_if_fail (HCP_IS_APP_LIST (al));
 
-  priv = al->priv;
+  hcp_trace_begin ("gconf_categories", NULL);
 
   client = gconf_client_get_default ();
   
@@ -198,9 +709,8 @@ hcp_app_list_get_configured_categories (HCPAppList *al)
 
     category->id = (gchar *) group_ids_i->data;
     category->name = (gchar *) group_names_i->data;
-    category->apps = NULL;
 
-    priv->categories = g_slist_append (priv->categories, category);
+    hcp_app_list_add_category (al->priv->gen, category);
 
     group_ids_i = g_slist_next (group_ids_i);
     group_names_i = g_slist_next (group_names_i);
@@ -212,127 +722,261 @@ cleanup:
 
   if (group_ids)
     g_slist_free (group_ids);
+
+  hcp_trace_end ("gconf_categories");
 }
 
 static void
-hcp_app_list_init (HCPAppList *al)
+hcp_app_list_add_categories (HCPAppList *al)
 {
-  al->priv = HCP_APP_LIST_GET_PRIVATE (al);
-
   HCPCategory *extras_category = g_new0 (HCPCategory, 1);
 
-  al->priv->apps = g_hash_table_new (g_str_hash, g_str_equal);
-
   hcp_app_list_get_configured_categories (al);
   
   /* Add the default category as the last one */
   extras_category->id   = g_strdup ("");
   extras_category->name = g_strdup (HCP_SEPARATOR_DEFAULT);
-  extras_category->apps = NULL;
-
-  al->priv->categories = g_slist_append (al->priv->categories, extras_category);
 
-  al->priv->monitor = NULL;
-  
-  GFile *directory;
-  directory = g_file_new_for_path (CONTROLPANEL_ENTRY_DIR);
-  hcp_init_monitor (al, directory);
-  g_object_unref (directory);
+  hcp_app_list_add_category (al->priv->gen, extras_category);
+  al->priv->gen->default_category = extras_category;
 }
 
 static void
-hcp_app_list_free_category (HCPCategory* category)
+hcp_app_list_read_layers (GPtrArray *layers, gboolean parallel)
 {
-  g_slist_free (category->apps);
-  category->apps = NULL;
-
-  if (category->id)
-    g_free (category->id);
-
-  if (category->name)
-    g_free (category->name);
+  guint i;
 
-  g_free (category);
-}
+  hcp_trace_begin ("read_dirs", NULL);
 
-static void
-hcp_app_list_empty_category (HCPCategory* category)
-{
-  if (category->apps)
+  for (i = 0; i < layers->len; i++)
   {
-    g_slist_free (category->apps);
-    category->apps = NULL;
+    HCPAppListLayer *layer = g_ptr_array_index (layers, i);
+
+    hcp_app_dir_read (layer->dir, parallel);
   }
+
+  hcp_trace_end ("read_dirs");
 }
 
-static gboolean
-hcp_app_list_free_app (gchar *plugin, HCPApp *app)
+/* Runs in a worker thread, only touches the HCPAppDir of each layer
+ * until hcp_app_list_update () joins it. Off the main thread, so the
+ * files may be parsed in parallel. */
+static gpointer
+hcp_app_list_reader_thread (GPtrArray *layers)
 {
-  g_free (plugin);
+  hcp_app_list_read_layers (layers, TRUE);
 
-  if (app)
-    g_object_unref (app);
-
-  return TRUE;
+  return NULL;
 }
 
+/* Waits for the reader started by hcp_app_list_start_update (), or
+ * reads the directories now if there was none */
 static void
-hcp_app_list_finalize (GObject *object)
+hcp_app_list_finish_reading (HCPAppList *al)
 {
-  HCPAppListPrivate *priv;
-  
-  g_return_if_fail (object);
-  g_return_if_fail (HCP_IS_APP_LIST (object));
-
-  priv = HCP_APP_LIST (object)->priv;
+  HCPAppListPrivate *priv = al->priv;
 
-  if (priv->apps != NULL) 
+  if (priv->reader)
   {
-    g_hash_table_foreach_remove (priv->apps, (GHRFunc) hcp_app_list_free_app, NULL);
-    g_hash_table_destroy (priv->apps);
+    g_thread_join (priv->reader);
+    priv->reader = NULL;
   }
-
-  if (priv->categories != NULL) 
+  else if (!priv->dirs_read)
   {
-    g_slist_foreach (priv->categories, (GFunc) hcp_app_list_free_category, NULL);
-    g_slist_free (priv->categories);
+    hcp_app_list_read_layers (priv->layers, FALSE);
   }
 
-  if (priv->monitor)
-  {
-    g_file_monitor_cancel (priv->monitor);
-  }
-    
-  G_OBJECT_CLASS (hcp_app_list_parent_class)->finalize (object);
+  priv->dirs_read = FALSE;
 }
 
 static void
-hcp_app_list_get_property (GObject    *gobject,
-                           guint      prop_id,
-                           GValue     *value,
-                           GParamSpec *pspec)
+hcp_app_list_init (HCPAppList *al)
 {
-  HCPAppListPrivate *priv;
+  al->priv = HCP_APP_LIST_GET_PRIVATE (al);
 
-  priv = HCP_APP_LIST (gobject)->priv;
+  al->priv->gen = hcp_app_list_generation_new (0);
 
-  switch (prop_id)
-  {
-    case PROP_APPS:
-      g_value_set_pointer (value, priv->apps);
-      break;
+  al->priv->retired = g_hash_table_new (g_str_hash, g_str_equal);
+  al->priv->modified = g_hash_table_new (g_direct_hash, g_direct_equal);
 
-    case PROP_CATEGORIES:
-      g_value_set_pointer (value, priv->categories);
-      break;
+  al->priv->entries = g_hash_table_new (g_str_hash, g_str_equal);
 
-    default:
-      G_OBJECT_WARN_INVALID_PROPERTY_ID (gobject, prop_id, pspec);
-      break;
-  }
-}
+  al->priv->sys_info = hcp_sys_info_new ();
 
-static void
+  g_signal_connect (al->priv->sys_info, "changed",
+                    G_CALLBACK (hcp_app_list_sys_info_changed_cb),
+                    al);
+
+  al->priv->reader = NULL;
+  al->priv->dirs_read = FALSE;
+
+  /* The categories are read from GConf by the first update */
+
+  /* The search path, later directories override earlier ones */
+  al->priv->layers = g_ptr_array_new ();
+
+  hcp_app_list_add_layer (al, CONTROLPANEL_ENTRY_DIR, FALSE);
+
+#ifdef CONTROLPANEL_VENDOR_ENTRY_DIR
+  hcp_app_list_add_layer (al, CONTROLPANEL_VENDOR_ENTRY_DIR, TRUE);
+#endif
+
+  {
+    gchar *user_dir = g_build_filename (g_get_user_data_dir (),
+                                        HCP_USER_ENTRY_REL_DIR,
+                                        NULL);
+
+    hcp_app_list_add_layer (al, user_dir, TRUE);
+
+    g_free (user_dir);
+  }
+}
+
+static void
+hcp_app_list_free_category (HCPCategory* category)
+{
+  g_sequence_free (category->apps);
+  category->apps = NULL;
+
+  if (category->id)
+    g_free (category->id);
+
+  if (category->name)
+    g_free (category->name);
+
+  g_free (category);
+}
+
+/* The keys are the interned plugin names of the apps */
+static gboolean
+hcp_app_list_free_app (const gchar *plugin, HCPApp *app)
+{
+  if (app)
+    g_object_unref (app);
+
+  return TRUE;
+}
+
+static void
+hcp_app_list_generation_free (HCPAppListGeneration *gen)
+{
+  g_hash_table_foreach_remove (gen->apps, (GHRFunc) hcp_app_list_free_app, NULL);
+  g_hash_table_destroy (gen->apps);
+  g_hash_table_destroy (gen->owners);
+
+  g_hash_table_destroy (gen->sorted_apps);
+  g_hash_table_destroy (gen->category_index);
+
+  g_slist_foreach (gen->categories, (GFunc) hcp_app_list_free_category, NULL);
+  g_slist_free (gen->categories);
+  g_ptr_array_free (gen->category_array, TRUE);
+
+  g_free (gen);
+}
+
+static void
+hcp_app_list_finalize (GObject *object)
+{
+  HCPAppListPrivate *priv;
+  
+  g_return_if_fail (object);
+  g_return_if_fail (HCP_IS_APP_LIST (object));
+
+  priv = HCP_APP_LIST (object)->priv;
+
+  if (priv->reader != NULL)
+    g_thread_join (priv->reader);
+
+  if (priv->gen != NULL)
+    hcp_app_list_generation_free (priv->gen);
+
+  if (priv->retired != NULL)
+  {
+    g_hash_table_foreach_remove (priv->retired, (GHRFunc) hcp_app_list_free_app, NULL);
+    g_hash_table_destroy (priv->retired);
+  }
+
+  if (priv->modified != NULL)
+    g_hash_table_destroy (priv->modified);
+
+  if (priv->entries != NULL)
+    g_hash_table_destroy (priv->entries);
+
+  if (priv->layers != NULL)
+  {
+    g_ptr_array_foreach (priv->layers, (GFunc) hcp_app_list_free_layer, NULL);
+    g_ptr_array_free (priv->layers, TRUE);
+  }
+
+  if (priv->sys_info != NULL)
+  {
+    g_signal_handlers_disconnect_by_func (priv->sys_info,
+                                          hcp_app_list_sys_info_changed_cb,
+                                          object);
+    g_object_unref (priv->sys_info);
+  }
+    
+  G_OBJECT_CLASS (hcp_app_list_parent_class)->finalize (object);
+}
+
+static void
+hcp_app_list_get_property (GObject    *gobject,
+                           guint      prop_id,
+                           GValue     *value,
+                           GParamSpec *pspec)
+{
+  HCPAppListPrivate *priv;
+
+  priv = HCP_APP_LIST (gobject)->priv;
+
+  switch (prop_id)
+  {
+    case PROP_APPS:
+      g_value_set_pointer (value, priv->gen->apps);
+      break;
+
+    case PROP_CATEGORIES:
+      g_value_set_pointer (value, priv->gen->categories);
+      break;
+
+    case PROP_CATEGORY_INDEX:
+      g_value_set_pointer (value, priv->gen->category_index);
+      break;
+
+    case PROP_GENERATION:
+      g_value_set_uint (value, priv->gen->serial);
+      break;
+
+    case PROP_EVENTS_RECEIVED:
+    case PROP_UPDATES:
+    {
+      guint total = 0;
+      guint i;
+
+      for (i = 0; i < priv->layers->len; i++)
+      {
+        HCPAppListLayer *layer = g_ptr_array_index (priv->layers, i);
+        guint count = 0;
+
+        g_object_get (G_OBJECT (layer->debouncer),
+                      prop_id == PROP_UPDATES ? "flushes" : "events-received",
+                      &count,
+                      NULL);
+
+        total += count;
+      }
+
+      g_value_set_uint (value, total);
+      break;
+    }
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (gobject, prop_id, pspec);
+      break;
+  }
+}
+
+static void
 hcp_app_list_class_init (HCPAppListClass *class)
 {
   GObjectClass *g_object_class = (GObjectClass *) class;
@@ -350,6 +994,17 @@ hcp_app_list_class_init (HCPAppListClass *class)
                       g_cclosure_marshal_VOID__VOID,
                       G_TYPE_NONE, 0);
 
+  signals[SIGNAL_APPS_CHANGED] =
+        g_signal_new ("apps-changed",
+                      G_OBJECT_CLASS_TYPE (g_object_class),
+                      G_SIGNAL_RUN_FIRST,
+                      G_STRUCT_OFFSET (HCPAppListClass, apps_changed),
+                      NULL, NULL,
+                      hcp_marshal_VOID__UINT_POINTER,
+                      G_TYPE_NONE, 2,
+                      G_TYPE_UINT,
+                      G_TYPE_POINTER);
+
   g_object_class_install_property (g_object_class,
                                    PROP_APPS,
                                    g_param_spec_pointer ("apps",
@@ -364,319 +1019,680 @@ hcp_app_list_class_init (HCPAppListClass *class)
                                                          "Categories List",
                                                          G_PARAM_READABLE));
 
+  g_object_class_install_property (g_object_class,
+                                   PROP_CATEGORY_INDEX,
+                                   g_param_spec_pointer ("category-index",
+                                                         "Category index",
+                                                         "Categories by id, ignoring case",
+                                                         G_PARAM_READABLE));
+
+  g_object_class_install_property (g_object_class,
+                                   PROP_GENERATION,
+                                   g_param_spec_uint ("generation",
+                                                      "Generation",
+                                                      "Number of times the whole list was rebuilt",
+                                                      0,
+                                                      G_MAXUINT,
+                                                      0,
+                                                      G_PARAM_READABLE));
+
+  g_object_class_install_property (g_object_class,
+                                   PROP_EVENTS_RECEIVED,
+                                   g_param_spec_uint ("events-received",
+                                                      "Events received",
+                                                      "Directory monitor events received",
+                                                      0,
+                                                      G_MAXUINT,
+                                                      0,
+                                                      G_PARAM_READABLE));
+
+  g_object_class_install_property (g_object_class,
+                                   PROP_UPDATES,
+                                   g_param_spec_uint ("updates",
+                                                      "Updates",
+                                                      "Updates performed for monitor events",
+                                                      0,
+                                                      G_MAXUINT,
+                                                      0,
+                                                      G_PARAM_READABLE));
+
   g_type_class_add_private (g_object_class, sizeof (HCPAppListPrivate));
 }
 
-/* for fmtx pp-bit handling */
-#define SYSINFO_SERVICE_DBUS "com.nokia.SystemInfo"
-#define SYSINFO_PATH_DBUS "/com/nokia/SystemInfo"
-#define SYSINFO_INTERFACE_DBUS "com.nokia.SystemInfo"
-#define SYSINFO_METHOD "GetConfigValue"
+/* for fmtx pp-bit handling, applies to fmtx applets which do not
+ * declare HCP_DESKTOP_KEY_REQUIRES themselves: on the devices which
+ * have FMTX disabled (first byte of fmtx-raw is 1) there is no sense
+ * to show this applet */
 #define SYSINFO_KEY_FMTX "/certs/ccc/pp/fmtx-raw"
+#define HCP_FMTX_REQUIRES SYSINFO_KEY_FMTX"[0]!=1"
 
-/*
- * Nasty hack in HCP... 
- * i think this should be somewhere else...
- * but well on the devices which has disabled FMTX
- * there is no sense to show this applet ...
- */
+static const gchar *
+hcp_app_list_entry_get_requires (HCPDesktopEntry *entry)
+{
+  if (entry->requires != NULL)
+    return entry->requires;
+
+  if (g_strrstr (entry->filename, "cpfmtx"))
+    return HCP_FMTX_REQUIRES;
+
+  return NULL;
+}
+
+/* Gated applets stay hidden until SystemInfo answered, the scan
+ * itself never waits for the bus */
 static gboolean
-hcp_app_is_fmtx_enabled ()
+hcp_app_list_entry_is_enabled (HCPAppList *al, HCPDesktopEntry *entry)
 {
-    DBusGConnection  *connection;
-    DBusGProxy       *proxy = NULL;
+  const gchar *requires = hcp_app_list_entry_get_requires (entry);
 
-    GError           *error = NULL;
-    GArray           *array = NULL;
-    gboolean          result = FALSE;
-    unsigned char     type;
+  if (requires == NULL)
+    return TRUE;
 
-    connection = dbus_g_bus_get (DBUS_BUS_SYSTEM, NULL);
+  return hcp_sys_info_match (al->priv->sys_info,
+                             requires) == HCP_SYS_INFO_MET;
+}
 
-    if (connection == NULL || error)
-        return FALSE;
+/* Queries the SystemInfo keys of all the gated entries in one go,
+ * before the entries are looked at one by one */
+static void
+hcp_app_list_prefetch_requirements (HCPAppList *al, GHashTable *entries)
+{
+  GHashTable *requirements;
+  GHashTableIter iter;
+  gpointer value;
 
-    proxy = dbus_g_proxy_new_for_name (connection,
-                                       SYSINFO_SERVICE_DBUS,
-                                       SYSINFO_PATH_DBUS,
-                                       SYSINFO_INTERFACE_DBUS);
-    if (proxy == NULL)
-    {
-        g_warning ("hcp_app_is_fmtx_disabled: "
-                   "Couldn't create the proxy object\n");
-        return FALSE;
-    }
+  requirements = g_hash_table_new (g_str_hash, g_str_equal);
 
-    result = dbus_g_proxy_call (proxy, SYSINFO_METHOD, &error,
-                                G_TYPE_STRING,
-                                SYSINFO_KEY_FMTX,
-                                G_TYPE_INVALID,
-                                dbus_g_type_get_collection ("GArray", G_TYPE_UCHAR),
-                                &array, G_TYPE_INVALID);
-    if (!result || error)
-    {
-        g_warning ("hcp_app_is_fmtx_disabled: "
-                   "Unable to get stored fmtx settings\n");
-        g_clear_error (&error);
-        return FALSE;
-    }
-    else
-    {
-        type = g_array_index (array, unsigned char, 0);
-        g_array_free (array, TRUE);
-    }
+  g_hash_table_iter_init (&iter, entries);
 
-    g_object_unref (proxy);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+  {
+    const gchar *requires;
 
-    if (type == 1) /* fmtx disabled */
-        return FALSE;
+    requires = hcp_app_list_entry_get_requires ((HCPDesktopEntry *) value);
 
-    return TRUE;
+    if (requires)
+      g_hash_table_replace (requirements, (gpointer) requires, NULL);
+  }
+
+  if (g_hash_table_size (requirements) > 0)
+    hcp_sys_info_prefetch (al->priv->sys_info, requirements);
+
+  g_hash_table_destroy (requirements);
 }
 
-static void 
-hcp_app_list_read_desktop_entries (HCPAppList *al, const gchar *dir_path)
+static void
+hcp_app_list_unsort_app (HCPAppListGeneration *gen, HCPApp *app)
 {
-  HCPAppListPrivate *priv;
-  GDir *dir;
-  GError *error = NULL;
-  const char *filename;
-  GKeyFile *keyfile, *pos_keyfile;
-  gchar *pos_path = NULL;
-  gboolean use_pos = TRUE;
+  GSequenceIter *iter;
 
-  g_return_if_fail (al);
-  g_return_if_fail (HCP_IS_APP_LIST (al));
-  g_return_if_fail (dir_path);
+  iter = g_hash_table_lookup (gen->sorted_apps, app);
 
-  priv = al->priv;
+  if (iter)
+  {
+    g_sequence_remove (iter);
+    g_hash_table_remove (gen->sorted_apps, app);
+  }
+}
 
-  dir = g_dir_open(dir_path, 0, &error);
+/* Moves the app of plugin out of gen, to be reused by the next entry
+ * naming plugin or dropped at the end of the update */
+static void
+hcp_app_list_release_app (HCPAppList           *al,
+                          HCPAppListGeneration *gen,
+                          const gchar          *plugin)
+{
+  gpointer key, app;
 
-  if (!dir)
-  {
-    g_warning ("Error reading desktop files directory: %s", error->message);
-    g_error_free (error);
+  if (!g_hash_table_lookup_extended (gen->apps, plugin, &key, &app))
     return;
+
+  hcp_app_list_unsort_app (gen, app);
+
+  g_hash_table_steal (gen->apps, plugin);
+  g_hash_table_remove (gen->owners, plugin);
+
+  g_hash_table_insert (al->priv->retired, key, app);
+}
+
+/* The app which had plugin before the current update, if any */
+static HCPApp *
+hcp_app_list_take_previous_app (HCPAppList           *al,
+                                HCPAppListGeneration *gen,
+                                const gchar          *plugin)
+{
+  HCPAppListPrivate *priv = al->priv;
+  gpointer key, app = NULL;
+
+  if (g_hash_table_lookup_extended (priv->retired, plugin, &key, &app))
+    g_hash_table_steal (priv->retired, plugin);
+  else if (gen != priv->gen)
+  {
+    /* Building a new generation, the current one keeps its ref */
+    app = g_hash_table_lookup (priv->gen->apps, plugin);
+
+    if (app)
+      g_object_ref (app);
   }
 
-  keyfile = g_key_file_new ();
+  return app;
+}
+
+static void
+hcp_app_list_flush_retired (HCPAppList *al)
+{
+  g_hash_table_foreach_remove (al->priv->retired,
+                               (GHRFunc) hcp_app_list_free_app,
+                               NULL);
+}
+
+static HCPApp *
+hcp_app_list_add_entry (HCPAppList           *al,
+                        HCPAppListGeneration *gen,
+                        HCPDesktopEntry      *entry)
+{
+  HCPDesktopEntry *owner;
+  GObject *app = NULL;
+  gint pos;
+
+  /* Do not load applets whose requirements are not met */
+  if (!hcp_app_list_entry_is_enabled (al, entry))
+    return NULL;
+
+  owner = g_hash_table_lookup (gen->owners, entry->plugin);
+
+  if (owner == entry)
+    return NULL;
 
-  /* try to open keyfile with app positions */
-  pos_keyfile = g_key_file_new ();
-  pos_path = g_strdup_printf ( "%s/"HCP_POS_REL_PATH, dir_path );
-  if (!g_key_file_load_from_file (pos_keyfile, pos_path, G_KEY_FILE_NONE, NULL))
+  /* Another file names the same plugin, the first one wins */
+  if (owner)
   {
-    g_debug ("no keyfile found or there was a problem while parsing %s", pos_path);
-    use_pos = FALSE;
+    if (strcmp (owner->filename, entry->filename) < 0)
+      return NULL;
+
+    hcp_app_list_release_app (al, gen, entry->plugin);
   }
 
-  while ((filename = g_dir_read_name (dir)))
+  pos = entry->pos ? entry->pos : G_MAXINT;
+
+  app = (GObject *) hcp_app_list_take_previous_app (al, gen, entry->plugin);
+
+  if (app)
+  {
+    if (hcp_app_update (HCP_APP (app),
+                        entry->name,
+                        entry->icon,
+                        entry->category,
+                        entry->text_domain,
+                        pos))
+      g_hash_table_insert (al->priv->modified, app, app);
+  }
+  else
   {
-    GObject *app = NULL;
-    error = NULL;
-    gchar *desktop_path = NULL;
-    gchar *name = NULL;
-    gchar *plugin = NULL;
-    gchar *icon = NULL;
-    gchar *category = NULL;
-    gchar *text_domain = NULL;
-    gint pos = 0;
+    app = hcp_app_new_full (entry->name,
+                            entry->plugin,
+                            entry->icon,
+                            entry->category,
+                            entry->text_domain,
+                            pos);
+  }
 
-    /* Only consider .desktop files */
-    if (!g_str_has_suffix (filename, ".desktop"))
-      continue;
+  g_hash_table_insert (gen->apps, (gpointer) entry->plugin, app);
+  g_hash_table_insert (gen->owners, (gpointer) entry->plugin, entry);
 
-    /* Do not load fmtx applet when its disabled */
-    if (g_strrstr (filename, "cpfmtx") &&
-        ! hcp_app_is_fmtx_enabled ())
-      continue;
+  return HCP_APP (app);
+}
+
+static gint
+hcp_app_list_compare_entries (gconstpointer a, gconstpointer b)
+{
+  return strcmp (((const HCPDesktopEntry *) a)->filename,
+                 ((const HCPDesktopEntry *) b)->filename);
+}
+
+/* Creates the apps for entries in filename order, so that when two
+ * .desktop files name the same plugin the first one gets the app
+ * without the other being made at all */
+static void
+hcp_app_list_add_entries (HCPAppList           *al,
+                          HCPAppListGeneration *gen,
+                          GHashTable           *entries)
+{
+  GList *values, *l;
 
-    desktop_path = g_build_filename (dir_path, filename, NULL);
+  hcp_app_list_prefetch_requirements (al, entries);
 
-    g_key_file_load_from_file (keyfile,
-                               desktop_path,
-                               G_KEY_FILE_NONE,
-                               &error);
+  values = g_hash_table_get_values (entries);
+  values = g_list_sort (values, hcp_app_list_compare_entries);
 
-    g_free (desktop_path);
+  for (l = values; l; l = l->next)
+    hcp_app_list_add_entry (al, gen, (HCPDesktopEntry *) l->data);
 
-    if (error)
-    {
-      g_warning ("Error reading applet desktop file: %s", error->message);
-      g_error_free (error);
-      continue;
-    }
+  g_list_free (values);
+}
 
-    name = g_key_file_get_locale_string (keyfile,
-                                         HCP_DESKTOP_GROUP,
-                                         HCP_DESKTOP_KEY_NAME,
-                                         NULL /* current locale */,
-                                         &error);
+static gint
+hcp_app_list_compare_apps (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+  return hcp_app_sort_func ((const HCPApp *) a, (const HCPApp *) b);
+}
 
-    if (error)
-    {
-      g_warning ("Error reading applet desktop file: %s", error->message);
-      g_error_free (error);
-      continue;
-    }
+static HCPCategory *
+hcp_app_list_get_app_category (HCPAppListGeneration *gen, HCPApp *app)
+{
+  HCPCategory *category = NULL;
+  const gchar *category_id = hcp_app_peek_category (app);
 
-    plugin = g_key_file_get_string (keyfile,
-                                    HCP_DESKTOP_GROUP,
-                                    HCP_DESKTOP_KEY_PLUGIN,
-                                    &error);
+  /* Find a category for this applet */
+  if (category_id)
+    category = g_hash_table_lookup (gen->category_index, category_id);
 
-    if (error)
-    {
-      g_warning ("Error reading applet desktop file: %s", error->message);
-      g_error_free (error);
+  /* If category doesn't exist or wasn't matched,
+   * add to the default one (Extra) */
+  if (!category)
+    category = gen->default_category;
+
+  return category;
+}
+
+/* Inserts a single app at its place in its category */
+static void
+hcp_app_list_sort_by_category (gpointer key, gpointer value, gpointer user_data)
+{
+  HCPAppListGeneration *gen = (HCPAppListGeneration *) user_data;
+  HCPApp *app = (HCPApp *) value;
+  HCPCategory *category;
+  GSequenceIter *iter;
+
+  g_return_if_fail (gen);
+  g_return_if_fail (app);
+  g_return_if_fail (HCP_IS_APP (app));
+
+  category = hcp_app_list_get_app_category (gen, app);
+
+  iter = g_sequence_insert_sorted (category->apps,
+                                   app,
+                                   hcp_app_list_compare_apps,
+                                   NULL);
+
+  g_hash_table_insert (gen->sorted_apps, app, iter);
+}
+
+/* Adds app at the end of its category, which has to be sorted
+ * afterwards, see hcp_app_list_sort_category () */
+static void
+hcp_app_list_append_to_category (gpointer key, gpointer value, gpointer user_data)
+{
+  HCPAppListGeneration *gen = (HCPAppListGeneration *) user_data;
+  HCPApp *app = (HCPApp *) value;
+  HCPCategory *category;
+  GSequenceIter *iter;
+
+  category = hcp_app_list_get_app_category (gen, app);
+
+  iter = g_sequence_append (category->apps, app);
+
+  g_hash_table_insert (gen->sorted_apps, app, iter);
+}
+
+static void
+hcp_app_list_sort_category (HCPCategory *category)
+{
+  g_sequence_sort (category->apps, hcp_app_list_compare_apps, NULL);
+}
+
+/* After a language switch every app shows, and sorts by, another
+ * name: reports them all as modified and sorts the current
+ * generation again. Returns TRUE if the locale changed. */
+static gboolean
+hcp_app_list_apply_locale (HCPAppList *al)
+{
+  GHashTableIter iter;
+  gpointer app;
+
+  if (!hcp_app_check_locale ())
+    return FALSE;
+
+  g_hash_table_iter_init (&iter, al->priv->gen->apps);
+
+  while (g_hash_table_iter_next (&iter, NULL, &app))
+    g_hash_table_insert (al->priv->modified, app, app);
+
+  g_slist_foreach (al->priv->gen->categories,
+                   (GFunc) hcp_app_list_sort_category, NULL);
+
+  return TRUE;
+}
+
+/* The enabled entry other than entry naming the same plugin that
+ * comes first in filename order, if any */
+static HCPDesktopEntry *
+hcp_app_list_find_plugin_entry (HCPAppList *al, HCPDesktopEntry *entry)
+{
+  HCPDesktopEntry *found = NULL;
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, al->priv->entries);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+  {
+    HCPDesktopEntry *other = (HCPDesktopEntry *) value;
+
+    /* Plugin names are interned */
+    if (other == entry || other->plugin != entry->plugin)
       continue;
-    }
 
-    icon = g_key_file_get_string (keyfile,
-                                  HCP_DESKTOP_GROUP,
-                                  HCP_DESKTOP_KEY_ICON,
-                                  &error);
-    if (error)
-    {
-      g_error_free (error);
-      error = NULL;
-    }
+    if ((found == NULL || strcmp (other->filename, found->filename) < 0) &&
+        hcp_app_list_entry_is_enabled (al, other))
+      found = other;
+  }
 
-    category = g_key_file_get_string (keyfile,
-                                      HCP_DESKTOP_GROUP,
-                                      HCP_DESKTOP_KEY_CATEGORY,
-                                      &error);
+  return found;
+}
 
-    if (error)
-    {
-      g_error_free (error);
-      error = NULL;
-    }
+static void
+hcp_app_list_remove_entry (HCPAppList *al, HCPDesktopEntry *entry)
+{
+  HCPAppListGeneration *gen = al->priv->gen;
+  HCPDesktopEntry *next;
+  HCPApp *app;
 
-    text_domain = g_key_file_get_string (keyfile,
-                                         HCP_DESKTOP_GROUP,
-                                         HCP_DESKTOP_KEY_TEXT_DOMAIN,
-                                         &error);
+  /* Gated entries never got an app, and of the entries naming the
+   * same plugin only one has it */
+  if (g_hash_table_lookup (gen->owners, entry->plugin) != entry)
+    return;
 
-    if (error)
-    {
-      g_error_free (error);
-      error = NULL;
-    }
+  /* Kept until the end of the update in case it comes back */
+  hcp_app_list_release_app (al, gen, entry->plugin);
 
-    /* try to read position from global .desktop file */
-    if (use_pos && category)
-    {
-      gchar* group_title = g_ascii_strdown (category, -1);
-      pos = g_key_file_get_integer (pos_keyfile,
-                                    group_title,
-                                    filename,
-                                    NULL);
-      g_free(group_title);
-    }
+  /* Another file naming the plugin takes the app over */
+  next = hcp_app_list_find_plugin_entry (al, entry);
+
+  if (next)
+  {
+    app = hcp_app_list_add_entry (al, gen, next);
+
+    if (app)
+      hcp_app_list_sort_by_category (NULL, app, gen);
+  }
+}
+
+/* The entry for filename from the last layer which has one */
+static HCPDesktopEntry *
+hcp_app_list_find_entry (HCPAppList *al, const gchar *filename)
+{
+  GPtrArray *layers = al->priv->layers;
+  guint i;
+
+  for (i = layers->len; i > 0; i--)
+  {
+    HCPAppListLayer *layer = g_ptr_array_index (layers, i - 1);
+    HCPDesktopEntry *entry;
+
+    entry = g_hash_table_lookup (layer->dir->entries, filename);
+
+    if (entry)
+      return entry;
+  }
+
+  return NULL;
+}
+
+/* Drops the apps of filenames taken from layer, before the layer
+ * re-reads (and frees) their entries */
+static void
+hcp_app_list_detach_layer_entries (HCPAppList      *al,
+                                   HCPAppListLayer *layer,
+                                   GHashTable      *filenames)
+{
+  HCPAppListPrivate *priv = al->priv;
+  GHashTableIter iter;
+  gpointer filename;
+
+  g_hash_table_iter_init (&iter, filenames);
+
+  while (g_hash_table_iter_next (&iter, &filename, NULL))
+  {
+    HCPDesktopEntry *entry = g_hash_table_lookup (priv->entries, filename);
+
+    if (entry == NULL ||
+        g_hash_table_lookup (layer->dir->entries, filename) != entry)
+      continue;
+
+    hcp_app_list_remove_entry (al, entry);
+    g_hash_table_remove (priv->entries, filename);
+  }
+}
+
+/* Picks the winning layer again for filenames, only touching the
+ * apps whose entry changed */
+static void
+hcp_app_list_merge_entries (HCPAppList *al, GHashTable *filenames)
+{
+  HCPAppListPrivate *priv = al->priv;
+  GHashTableIter iter;
+  GHashTable *merged;
+  GList *values, *l;
+  gpointer filename;
 
-    app = hcp_app_new ();
+  merged = g_hash_table_new (g_str_hash, g_str_equal);
+
+  g_hash_table_iter_init (&iter, filenames);
+
+  while (g_hash_table_iter_next (&iter, &filename, NULL))
+  {
+    HCPDesktopEntry *current, *entry;
 
-    g_object_set (G_OBJECT (app),
-                  "name", name,
-                  "plugin", plugin,
-                  "icon", icon,
-                  NULL); 
+    current = g_hash_table_lookup (priv->entries, filename);
+    entry = hcp_app_list_find_entry (al, filename);
 
-    if (category != NULL)
-      g_object_set (G_OBJECT (app),
-                    "category", category,
-                    NULL); 
+    if (current == entry)
+      continue;
 
-    if (text_domain != NULL)
+    if (current)
     {
-      g_object_set (G_OBJECT (app),
-                    "text-domain", text_domain,
-                    NULL);
+      hcp_app_list_remove_entry (al, current);
+      g_hash_table_remove (priv->entries, filename);
     }
 
-    if (pos)
+    if (entry)
     {
-      g_object_set (G_OBJECT (app),
-                    "suggested-pos", pos,
-                    NULL);
+      g_hash_table_replace (priv->entries, entry->filename, entry);
+      g_hash_table_replace (merged, entry->filename, entry);
     }
+  }
 
-    g_hash_table_insert (priv->apps, g_strdup (plugin), app);
+  hcp_app_list_prefetch_requirements (al, merged);
 
-    g_free (name);
-    g_free (plugin);
-    g_free (icon);
-    g_free (category);
-    g_free (text_domain);
+  values = g_hash_table_get_values (merged);
+  values = g_list_sort (values, hcp_app_list_compare_entries);
+
+  for (l = values; l; l = l->next)
+  {
+    HCPApp *app = hcp_app_list_add_entry (al, al->priv->gen,
+                                          (HCPDesktopEntry *) l->data);
+
+    if (app)
+      hcp_app_list_sort_by_category (NULL, app, al->priv->gen);
   }
 
-  g_key_file_free (keyfile);
-  g_key_file_free (pos_keyfile);
-  g_dir_close (dir);
-  g_free (pos_path);
+  g_list_free (values);
+  g_hash_table_destroy (merged);
+
+  hcp_app_list_flush_retired (al);
 }
 
-static gint
-hcp_app_list_find_category (gpointer a, gpointer b)
+/* Applies the created, changed and deleted .desktop files in
+ * filenames of one layer, leaving the other apps untouched */
+static void
+hcp_app_list_update_layer (HCPAppList      *al,
+                           HCPAppListLayer *layer,
+                           GHashTable      *filenames)
 {
-  HCPCategory *category = (HCPCategory *) a;
-  HCPApp *app = (HCPApp *) b;
-  gchar *category_id = NULL;
+  g_return_if_fail (al);
+  g_return_if_fail (HCP_IS_APP_LIST (al));
 
-  g_object_get (G_OBJECT (app),
-                "category", &category_id,
-                NULL);
+  hcp_app_list_detach_layer_entries (al, layer, filenames);
 
-  if (category_id && category->id &&
-      !g_ascii_strcasecmp (category_id, category->id))
-  {
-    g_free (category_id);
-    return 0;
-  }
+  hcp_app_dir_update (layer->dir, filenames);
 
-  g_free (category_id);
+  hcp_app_list_merge_entries (al, filenames);
+}
 
-  return 1;
+static void
+hcp_app_list_add_filenames (GHashTable *entries, GHashTable *filenames)
+{
+  GHashTableIter iter;
+  gpointer filename;
+
+  g_hash_table_iter_init (&iter, entries);
+
+  while (g_hash_table_iter_next (&iter, &filename, NULL))
+    g_hash_table_replace (filenames, g_strdup (filename), NULL);
 }
 
+/* Re-reads a whole layer, the other layers are only consulted for
+ * the basenames the layer had or has now */
 static void
-hcp_app_list_sort_by_category (gpointer key, gpointer value, gpointer user_data)
+hcp_app_list_reload_layer (HCPAppList *al, HCPAppListLayer *layer)
 {
-  HCPAppListPrivate *priv;
-  HCPAppList *al = (HCPAppList *) user_data;
-  HCPApp *app = (HCPApp *) value;
-  HCPCategory *category; 
-  GSList *category_item = NULL;
+  GHashTable *filenames;
 
   g_return_if_fail (al);
   g_return_if_fail (HCP_IS_APP_LIST (al));
-  g_return_if_fail (app);
-  g_return_if_fail (HCP_IS_APP (app));
 
-  priv = al->priv;
+  filenames = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
-  /* Find a category for this applet */
-  category_item = g_slist_find_custom (priv->categories,
-                                       app,
-                                       (GCompareFunc) hcp_app_list_find_category);
+  hcp_app_list_add_filenames (layer->dir->entries, filenames);
+
+  hcp_app_list_detach_layer_entries (al, layer, filenames);
+
+  hcp_app_dir_read (layer->dir, FALSE);
+
+  hcp_app_list_add_filenames (layer->dir->entries, filenames);
+
+  hcp_app_list_merge_entries (al, filenames);
+
+  g_hash_table_destroy (filenames);
+}
+
+/* Adds or removes the gated apps whose requirements changed, returns
+ * TRUE if the list changed */
+static gboolean
+hcp_app_list_refilter (HCPAppList *al)
+{
+  HCPAppListPrivate *priv = al->priv;
+  GList *values, *l;
+  gboolean changed = FALSE;
+
+  values = g_hash_table_get_values (priv->entries);
+  values = g_list_sort (values, hcp_app_list_compare_entries);
 
-  if (category_item)
+  for (l = values; l; l = l->next)
   {
-    category = (HCPCategory *) category_item->data;
+    HCPDesktopEntry *entry = (HCPDesktopEntry *) l->data;
+    gboolean enabled, shown;
+
+    if (!hcp_app_list_entry_get_requires (entry))
+      continue;
+
+    enabled = hcp_app_list_entry_is_enabled (al, entry);
+    shown = g_hash_table_lookup (priv->gen->owners, entry->plugin) == entry;
+
+    if (enabled && !shown)
+    {
+      HCPApp *app = hcp_app_list_add_entry (al, priv->gen, entry);
+
+      if (app)
+      {
+        hcp_app_list_sort_by_category (NULL, app, priv->gen);
+
+        changed = TRUE;
+      }
+    }
+    else if (!enabled && shown)
+    {
+      hcp_app_list_remove_entry (al, entry);
+
+      changed = TRUE;
+    }
   }
-  else
+
+  g_list_free (values);
+
+  hcp_app_list_flush_retired (al);
+
+  return changed;
+}
+
+static void
+hcp_app_list_sys_info_changed_cb (HCPSysInfo  *info,
+                                  HCPAppList  *al)
+{
+  GPtrArray *before = hcp_app_list_snapshot (al);
+  gboolean changed;
+
+  changed = hcp_app_list_refilter (al);
+
+  hcp_app_list_emit_changes (al, before);
+
+  if (changed)
+    g_signal_emit (G_OBJECT (al), 
+                   signals[SIGNAL_UPDATED], 
+                   0, NULL);
+}
+
+/* Translates and sorts the apps again if the locale changed since
+ * the last update, emitting "apps-changed" and "updated" */
+void
+hcp_app_list_check_locale (HCPAppList *al)
+{
+  GPtrArray *before;
+
+  g_return_if_fail (al);
+  g_return_if_fail (HCP_IS_APP_LIST (al));
+
+  before = hcp_app_list_snapshot (al);
+
+  if (!hcp_app_list_apply_locale (al))
   {
-    /* If category doesn't exist or wasn't matched,
-     * add to the default one (Extra) */
-    category = g_slist_last (priv->categories)->data;
+    hcp_app_list_free_snapshot (before);
+    return;
   }
 
-  category->apps = g_slist_insert_sorted (
-                                  category->apps,
-                                  app,
-                                  (GCompareFunc) hcp_app_sort_func);
+  hcp_app_list_emit_changes (al, before);
+
+  g_signal_emit (G_OBJECT (al),
+                 signals[SIGNAL_UPDATED],
+                 0, NULL);
+}
+
+HCPCategory *
+hcp_app_list_lookup_category (HCPAppList *al, const gchar *id)
+{
+  g_return_val_if_fail (al, NULL);
+  g_return_val_if_fail (HCP_IS_APP_LIST (al), NULL);
+  g_return_val_if_fail (id, NULL);
+
+  return g_hash_table_lookup (al->priv->gen->category_index, id);
+}
+
+/* The category at index in the "categories" list, NULL past its end */
+HCPCategory *
+hcp_app_list_get_category (HCPAppList *al, guint index)
+{
+  GPtrArray *categories;
+
+  g_return_val_if_fail (al, NULL);
+  g_return_val_if_fail (HCP_IS_APP_LIST (al), NULL);
+
+  categories = al->priv->gen->category_array;
+
+  if (index >= categories->len)
+    return NULL;
+
+  return g_ptr_array_index (categories, index);
 }
 
 GObject *
@@ -691,22 +1707,123 @@ void
 hcp_app_list_update (HCPAppList *al)
 {
   HCPAppListPrivate *priv;
+  HCPAppListGeneration *gen, *old_gen;
+  GPtrArray *before;
+  guint i;
+
+  g_return_if_fail (al);
+  g_return_if_fail (HCP_IS_APP_LIST (al));
+
+  priv = al->priv;
+
+  hcp_trace_begin ("hcp_app_list_update", NULL);
+
+  /* GConf is read here while a reader started before still goes
+   * through the directories */
+  if (priv->gen->default_category == NULL)
+    hcp_app_list_add_categories (al);
+
+  hcp_app_list_finish_reading (al);
+
+  before = hcp_app_list_snapshot (al);
+
+  hcp_app_list_apply_locale (al);
+
+  /* The current list stays in place until the new one is complete */
+  gen = hcp_app_list_generation_next (priv->gen);
+
+  /* Read all the entries, later layers override earlier ones */
+  g_hash_table_remove_all (priv->entries);
+
+  for (i = 0; i < priv->layers->len; i++)
+  {
+    HCPAppListLayer *layer = g_ptr_array_index (priv->layers, i);
+    GHashTableIter iter;
+    gpointer value;
+
+    g_hash_table_iter_init (&iter, layer->dir->entries);
+
+    while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      HCPDesktopEntry *entry = (HCPDesktopEntry *) value;
+
+      g_hash_table_replace (priv->entries, entry->filename, entry);
+    }
+  }
+
+  hcp_app_list_add_entries (al, gen, priv->entries);
+
+  /* Place them is the relevant category, sorting each one once */
+  g_hash_table_foreach (gen->apps,
+                        (GHFunc) hcp_app_list_append_to_category,
+                        gen);
+
+  g_slist_foreach (gen->categories, (GFunc) hcp_app_list_sort_category, NULL);
+
+  old_gen = priv->gen;
+  priv->gen = gen;
+
+  hcp_app_list_generation_free (old_gen);
+
+  hcp_app_list_emit_changes (al, before);
+
+  hcp_trace_end ("hcp_app_list_update");
+}
+
+/* Starts reading the applet directories for the next
+ * hcp_app_list_update () in a worker thread, so that it overlaps with
+ * whatever the caller does meanwhile. Meant for the first update,
+ * before any entry of the directories is in use. */
+void
+hcp_app_list_start_update (HCPAppList *al)
+{
+  HCPAppListPrivate *priv;
+  GError *error = NULL;
 
   g_return_if_fail (al);
   g_return_if_fail (HCP_IS_APP_LIST (al));
 
   priv = al->priv;
 
-  /* Clean the previous list */
-  g_hash_table_foreach_remove (priv->apps, (GHRFunc) hcp_app_list_free_app, NULL);
+  if (priv->dirs_read)
+    return;
+
+  priv->reader = g_thread_try_new ("hcp-dir-reader",
+                                   (GThreadFunc) hcp_app_list_reader_thread,
+                                   priv->layers,
+                                   &error);
+
+  if (priv->reader == NULL)
+  {
+    g_warning ("Error starting desktop files reader thread: %s",
+               error->message);
+    g_error_free (error);
+
+    hcp_app_list_read_layers (priv->layers, FALSE);
+  }
+
+  priv->dirs_read = TRUE;
+}
+
+guint
+hcp_app_list_category_get_n_apps (HCPCategory *category)
+{
+  g_return_val_if_fail (category, 0);
+
+  return g_sequence_get_length (category->apps);
+}
+
+HCPApp *
+hcp_app_list_category_get_app (HCPCategory *category, guint index)
+{
+  GSequenceIter *iter;
+
+  g_return_val_if_fail (category, NULL);
 
-  /* Read all the entries */
-  hcp_app_list_read_desktop_entries (al, CONTROLPANEL_ENTRY_DIR);
+  iter = g_sequence_get_iter_at_pos (category->apps, index);
 
-  /* Place them is the relevant category */
-  g_slist_foreach (priv->categories, (GFunc) hcp_app_list_empty_category, NULL);
+  if (g_sequence_iter_is_end (iter))
+    return NULL;
 
-  g_hash_table_foreach (priv->apps,
-                        (GHFunc) hcp_app_list_sort_by_category,
-                        al);
+  return g_sequence_get (iter);
 }
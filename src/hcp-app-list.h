@@ -28,6 +28,8 @@
 #include <glib.h>
 #include <glib-object.h>
 
+#include "hcp-app.h"
+
 G_BEGIN_DECLS
 
 typedef struct _HCPAppList HCPAppList;
@@ -53,6 +55,9 @@ struct _HCPAppListClass
   GObjectClass parent_class;
 
   void (*updated) (HCPAppList *al, gpointer user_data);
+
+  /* changes is a GArray of HCPAppChange, only valid during emission */
+  void (*apps_changed) (HCPAppList *al, guint generation, GArray *changes);
 };
 
 /* .desktop keys */
@@ -62,11 +67,35 @@ struct _HCPAppListClass
 #define HCP_DESKTOP_KEY_CATEGORY        "Categories"
 #define HCP_DESKTOP_KEY_PLUGIN          "X-control-panel-plugin"
 #define HCP_DESKTOP_KEY_TEXT_DOMAIN     "X-Text-Domain"
+#define HCP_DESKTOP_KEY_REQUIRES        "X-control-panel-requires"
+
+typedef enum
+{
+  HCP_APP_CHANGE_ADDED,
+  HCP_APP_CHANGE_REMOVED,
+  HCP_APP_CHANGE_MOVED,
+  HCP_APP_CHANGE_MODIFIED
+} HCPAppChangeType;
+
+/* One step of an "apps-changed" change set. Steps are to be applied
+ * in order, a position refers to the apps of the category as left by
+ * the steps before it: removals come first, from the last position
+ * down, then additions and moves by increasing position, then the
+ * apps whose name or icon changed. A move takes the app from
+ * old_position to position, for other steps both are the same. */
+typedef struct _HCPAppChange {
+  HCPAppChangeType  type;
+  HCPApp           *app;
+  guint             category;   /* index in the "categories" list */
+  guint             position;
+  guint             old_position;
+} HCPAppChange;
 
 typedef struct _HCPCategory {
   gchar   *id;
   gchar   *name;
-  GSList  *apps;
+  /* HCPApp, sorted with hcp_app_sort_func () */
+  GSequence *apps;
 } HCPCategory;
 
 GType        hcp_app_list_get_type    (void);
@@ -76,8 +105,23 @@ GObject*     hcp_app_list_new         (void);
 gboolean     hcp_app_list_focus_item  (HCPAppList  *al, 
                                        const gchar *entryname);
 
+void         hcp_app_list_start_update (HCPAppList  *al);
+
 void         hcp_app_list_update      (HCPAppList  *al);
 
+void         hcp_app_list_check_locale (HCPAppList *al);
+
+HCPCategory* hcp_app_list_lookup_category (HCPAppList  *al,
+                                           const gchar *id);
+
+HCPCategory* hcp_app_list_get_category (HCPAppList *al,
+                                        guint       index);
+
+guint        hcp_app_list_category_get_n_apps (HCPCategory *category);
+
+HCPApp*      hcp_app_list_category_get_app    (HCPCategory *category,
+                                               guint        index);
+
 G_END_DECLS
 
 #endif
@@ -0,0 +1,876 @@
+/*
+ * This file is part of hildon-control-panel
+ *
+ * Copyright (C) 2010 Nokia Corporation.
+ *
+ * Contact: Karoliina Salminen <karoliina.t.salminen@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib/gi18n.h>
+#include <gtk/gtk.h>
+
+#include "hcp-app-model.h"
+#include "hcp-app.h"
+#include "hcp-grid.h"
+#include "hcp-icon-cache.h"
+
+#define HCP_APP_MODEL_GET_PRIVATE(object) \
+        (G_TYPE_INSTANCE_GET_PRIVATE ((object), HCP_TYPE_APP_MODEL, HCPAppModelPrivate))
+
+static void hcp_app_model_tree_model_init (GtkTreeModelIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (HCPAppModel, hcp_app_model, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL,
+                                                hcp_app_model_tree_model_init));
+
+/* The rows of a category as last announced, and the index of the
+ * first of them */
+typedef struct
+{
+  gboolean header;
+  guint    n_apps;
+  gint     offset;
+} HCPAppModelSection;
+
+/* An iter holds the index of the category and the position of the
+ * app in it, -1 for the header */
+#define ITER_CATEGORY(iter)  GPOINTER_TO_UINT ((iter)->user_data)
+#define ITER_POSITION(iter)  GPOINTER_TO_INT ((iter)->user_data2)
+
+struct _HCPAppModelPrivate
+{
+  HCPAppList *al;
+  gint        icon_size;
+  gint        stamp;
+
+  /* HCPAppModelSection of each category, in list order. Only the
+   * first n_shown categories have rows, the others are not looked
+   * at until shown. */
+  GArray     *sections;
+  guint       n_shown;
+
+  /* How many sections from the first have an up to date offset */
+  guint       n_offsets;
+
+  /* HCPApp -> GdkPixbuf of the rows whose icon was asked for */
+  GHashTable *icons;
+};
+
+static GSList *
+hcp_app_model_get_categories (HCPAppModel *model)
+{
+  GSList *categories = NULL;
+
+  /* Every generation of the list has its own HCPCategory, they
+   * can't be kept around */
+  g_object_get (G_OBJECT (model->priv->al),
+                "categories", &categories,
+                NULL);
+
+  return categories;
+}
+
+/* Adds an empty section for each category the list got since the
+ * last call. The categories only ever grow, from none to those read
+ * by the first update. */
+static void
+hcp_app_model_add_sections (HCPAppModel *model)
+{
+  GSList *l;
+  guint i = 0;
+
+  for (l = hcp_app_model_get_categories (model); l; l = l->next, i++)
+  {
+    HCPAppModelSection section;
+
+    if (i < model->priv->sections->len)
+      continue;
+
+    section.n_apps = 0;
+    section.header = FALSE;
+    section.offset = 0;
+
+    g_array_append_val (model->priv->sections, section);
+  }
+}
+
+static HCPApp *
+hcp_app_model_get_app (HCPAppModel *model, guint category, gint position)
+{
+  HCPCategory *c;
+
+  if (position < 0)
+    return NULL;
+
+  c = hcp_app_list_get_category (model->priv->al, category);
+
+  return c ? hcp_app_list_category_get_app (c, position) : NULL;
+}
+
+static HCPAppModelSection *
+hcp_app_model_get_section (HCPAppModel *model, guint category)
+{
+  return &g_array_index (model->priv->sections,
+                         HCPAppModelSection,
+                         category);
+}
+
+static gint
+hcp_app_model_section_rows (HCPAppModelSection *section)
+{
+  return (section->header ? 1 : 0) + section->n_apps;
+}
+
+/* The rows of category were added or removed, the sections after
+ * it have moved */
+static void
+hcp_app_model_section_resized (HCPAppModel *model, guint category)
+{
+  model->priv->n_offsets = MIN (model->priv->n_offsets, category + 1);
+}
+
+/* Index of the first row of category, or the number of rows for
+ * the number of categories. Offsets moved by a resized section are
+ * only worked out again when asked for. */
+static gint
+hcp_app_model_get_offset (HCPAppModel *model, guint category)
+{
+  HCPAppModelPrivate *priv = model->priv;
+  HCPAppModelSection *section;
+
+  while (priv->n_offsets <= category && priv->n_offsets < priv->sections->len)
+  {
+    gint offset = 0;
+
+    if (priv->n_offsets > 0)
+    {
+      section = hcp_app_model_get_section (model, priv->n_offsets - 1);
+      offset = section->offset + hcp_app_model_section_rows (section);
+    }
+
+    hcp_app_model_get_section (model, priv->n_offsets++)->offset = offset;
+  }
+
+  if (category < priv->sections->len)
+    return hcp_app_model_get_section (model, category)->offset;
+
+  if (priv->sections->len == 0)
+    return 0;
+
+  section = hcp_app_model_get_section (model, priv->sections->len - 1);
+
+  return section->offset + hcp_app_model_section_rows (section);
+}
+
+static gint
+hcp_app_model_get_row (HCPAppModel *model, guint category, gint position)
+{
+  HCPAppModelSection *section = hcp_app_model_get_section (model, category);
+  gint row = hcp_app_model_get_offset (model, category);
+
+  if (position >= 0)
+    row += (section->header ? 1 : 0) + position;
+
+  return row;
+}
+
+static void
+hcp_app_model_set_iter (HCPAppModel *model,
+                        GtkTreeIter *iter,
+                        guint        category,
+                        gint         position)
+{
+  iter->stamp = model->priv->stamp;
+  iter->user_data = GUINT_TO_POINTER (category);
+  iter->user_data2 = GINT_TO_POINTER (position);
+  iter->user_data3 = NULL;
+}
+
+/* Looks for the last section starting at or before row, which is
+ * the one holding it, empty sections start where the next one does */
+static gboolean
+hcp_app_model_find_row (HCPAppModel *model, GtkTreeIter *iter, gint row)
+{
+  HCPAppModelSection *section;
+  gint low = 0, high, found = -1;
+
+  if (row < 0 || row >= hcp_app_model_get_offset (model, model->priv->sections->len))
+    return FALSE;
+
+  high = (gint) model->priv->sections->len - 1;
+
+  while (low <= high)
+  {
+    gint middle = (low + high) / 2;
+
+    if (hcp_app_model_get_section (model, middle)->offset <= row)
+    {
+      found = middle;
+      low = middle + 1;
+    }
+    else
+    {
+      high = middle - 1;
+    }
+  }
+
+  section = hcp_app_model_get_section (model, found);
+  row -= section->offset;
+
+  hcp_app_model_set_iter (model, iter, found,
+                          section->header ? row - 1 : row);
+
+  return TRUE;
+}
+
+static GdkPixbuf *
+hcp_app_model_get_icon (HCPAppModel *model, HCPApp *app)
+{
+  GdkPixbuf *pixbuf = g_hash_table_lookup (model->priv->icons, app);
+
+  if (pixbuf == NULL)
+  {
+    /* The default icon until the real one is decoded */
+    pixbuf = hcp_icon_cache_lookup (hcp_icon_cache_get_default (),
+                                    hcp_app_peek_icon (app),
+                                    model->priv->icon_size);
+
+    if (pixbuf)
+      g_hash_table_insert (model->priv->icons, app, g_object_ref (pixbuf));
+  }
+
+  return pixbuf;
+}
+
+static void
+hcp_app_model_row_changed (HCPAppModel *model, guint category, gint position)
+{
+  GtkTreePath *path;
+  GtkTreeIter iter;
+
+  path = gtk_tree_path_new_from_indices (
+      hcp_app_model_get_row (model, category, position), -1);
+  hcp_app_model_set_iter (model, &iter, category, position);
+
+  gtk_tree_model_row_changed (GTK_TREE_MODEL (model), path, &iter);
+
+  gtk_tree_path_free (path);
+}
+
+static void
+hcp_app_model_row_inserted (HCPAppModel *model, guint category, gint position)
+{
+  GtkTreePath *path;
+  GtkTreeIter iter;
+
+  path = gtk_tree_path_new_from_indices (
+      hcp_app_model_get_row (model, category, position), -1);
+  hcp_app_model_set_iter (model, &iter, category, position);
+
+  gtk_tree_model_row_inserted (GTK_TREE_MODEL (model), path, &iter);
+
+  gtk_tree_path_free (path);
+}
+
+static void
+hcp_app_model_row_deleted (HCPAppModel *model, gint row)
+{
+  GtkTreePath *path = gtk_tree_path_new_from_indices (row, -1);
+
+  gtk_tree_model_row_deleted (GTK_TREE_MODEL (model), path);
+
+  gtk_tree_path_free (path);
+}
+
+static void
+hcp_app_model_insert_app (HCPAppModel *model, guint category, gint position)
+{
+  HCPAppModelSection *section = hcp_app_model_get_section (model, category);
+
+  model->priv->stamp++;
+
+  if (!section->header)
+  {
+    section->header = TRUE;
+    hcp_app_model_section_resized (model, category);
+    hcp_app_model_row_inserted (model, category, -1);
+  }
+
+  section->n_apps++;
+  hcp_app_model_section_resized (model, category);
+  hcp_app_model_row_inserted (model, category, position);
+}
+
+static void
+hcp_app_model_delete_app (HCPAppModel *model, guint category, gint position)
+{
+  HCPAppModelSection *section = hcp_app_model_get_section (model, category);
+  gint row = hcp_app_model_get_row (model, category, position);
+
+  model->priv->stamp++;
+
+  section->n_apps--;
+  hcp_app_model_section_resized (model, category);
+  hcp_app_model_row_deleted (model, row);
+
+  /* Empty categories get no header */
+  if (section->n_apps == 0)
+  {
+    row = hcp_app_model_get_row (model, category, -1);
+    section->header = FALSE;
+    hcp_app_model_section_resized (model, category);
+    hcp_app_model_row_deleted (model, row);
+  }
+}
+
+static void
+hcp_app_model_move_app (HCPAppModel *model,
+                        guint        category,
+                        gint         from,
+                        gint         to)
+{
+  GtkTreePath *path;
+  gint *new_order;
+  gint n_rows, first, i;
+
+  n_rows = hcp_app_model_get_offset (model, model->priv->sections->len);
+  first = hcp_app_model_get_row (model, category, 0);
+
+  from += first;
+  to += first;
+
+  /* new_order[new row] = old row */
+  new_order = g_new (gint, n_rows);
+
+  for (i = 0; i < n_rows; i++)
+    new_order[i] = i;
+
+  if (from > to)
+    memmove (&new_order[to + 1], &new_order[to], (from - to) * sizeof (gint));
+  else
+    memmove (&new_order[from], &new_order[from + 1], (to - from) * sizeof (gint));
+
+  new_order[to] = from;
+
+  model->priv->stamp++;
+
+  path = gtk_tree_path_new ();
+  gtk_tree_model_rows_reordered (GTK_TREE_MODEL (model), path, NULL, new_order);
+  gtk_tree_path_free (path);
+
+  g_free (new_order);
+}
+
+/* Drops the icons of the apps using name, all of them if name is
+ * NULL, and has the rows drawn again. Rows that were never asked
+ * for their icon are left alone. */
+static void
+hcp_app_model_drop_icons (HCPAppModel *model, const gchar *name)
+{
+  GSList *l;
+  guint i, j;
+
+  l = hcp_app_model_get_categories (model);
+
+  for (i = 0; l && i < model->priv->sections->len; l = l->next, i++)
+  {
+    HCPCategory *category = (HCPCategory *) l->data;
+    HCPAppModelSection *section = hcp_app_model_get_section (model, i);
+
+    for (j = 0; j < section->n_apps; j++)
+    {
+      HCPApp *app = hcp_app_list_category_get_app (category, j);
+
+      if (app == NULL ||
+          (name && g_strcmp0 (hcp_app_peek_icon (app), name)))
+        continue;
+
+      if (g_hash_table_remove (model->priv->icons, app))
+        hcp_app_model_row_changed (model, i, j);
+    }
+  }
+}
+
+/* Whether the rows shown have as many apps as the list */
+static gboolean
+hcp_app_model_in_step (HCPAppModel *model)
+{
+  GSList *l;
+  guint i;
+
+  l = hcp_app_model_get_categories (model);
+
+  for (i = 0; i < model->priv->n_shown; i++)
+  {
+    HCPAppModelSection *section = hcp_app_model_get_section (model, i);
+    guint n_apps = 0;
+
+    if (l)
+    {
+      n_apps = hcp_app_list_category_get_n_apps ((HCPCategory *) l->data);
+      l = l->next;
+    }
+
+    if (n_apps != section->n_apps)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Removes all the rows and inserts them again from the list */
+static void
+hcp_app_model_reload (HCPAppModel *model)
+{
+  GSList *l;
+  guint i, j;
+
+  g_hash_table_remove_all (model->priv->icons);
+
+  for (i = model->priv->n_shown; i > 0; i--)
+  {
+    HCPAppModelSection *section = hcp_app_model_get_section (model, i - 1);
+
+    while (section->n_apps > 0)
+      hcp_app_model_delete_app (model, i - 1, section->n_apps - 1);
+  }
+
+  l = hcp_app_model_get_categories (model);
+
+  for (i = 0; l && i < model->priv->n_shown; l = l->next, i++)
+  {
+    guint n_apps = hcp_app_list_category_get_n_apps ((HCPCategory *) l->data);
+
+    for (j = 0; j < n_apps; j++)
+      hcp_app_model_insert_app (model, i, j);
+  }
+}
+
+/* Whether change can be replayed on the rows as they are */
+static gboolean
+hcp_app_model_change_fits (HCPAppModel *model, HCPAppChange *change)
+{
+  HCPAppModelSection *section;
+
+  if (change->category >= model->priv->sections->len)
+    return FALSE;
+
+  section = hcp_app_model_get_section (model, change->category);
+
+  switch (change->type)
+  {
+    case HCP_APP_CHANGE_ADDED:
+      return change->position <= section->n_apps;
+
+    case HCP_APP_CHANGE_MOVED:
+      return change->position < section->n_apps &&
+             change->old_position < section->n_apps;
+
+    default:
+      return change->position < section->n_apps;
+  }
+}
+
+static void
+hcp_app_model_apps_changed_cb (HCPAppList  *al,
+                               guint        generation,
+                               GArray      *changes,
+                               HCPAppModel *model)
+{
+  guint i;
+
+  hcp_app_model_add_sections (model);
+
+  for (i = 0; i < changes->len; i++)
+  {
+    HCPAppChange *change = &g_array_index (changes, HCPAppChange, i);
+
+    /* Categories not shown yet get their rows as they are then */
+    if (change->category >= model->priv->n_shown &&
+        change->category < model->priv->sections->len)
+      continue;
+
+    if (!hcp_app_model_change_fits (model, change))
+      break;
+
+    switch (change->type)
+    {
+      case HCP_APP_CHANGE_ADDED:
+        hcp_app_model_insert_app (model, change->category, change->position);
+        break;
+
+      case HCP_APP_CHANGE_REMOVED:
+        g_hash_table_remove (model->priv->icons, change->app);
+        hcp_app_model_delete_app (model, change->category, change->position);
+        break;
+
+      case HCP_APP_CHANGE_MOVED:
+        hcp_app_model_move_app (model, change->category,
+                                change->old_position, change->position);
+        break;
+
+      case HCP_APP_CHANGE_MODIFIED:
+        /* The name is read from the app when the row is drawn */
+        g_hash_table_remove (model->priv->icons, change->app);
+        hcp_app_model_row_changed (model, change->category, change->position);
+        break;
+    }
+  }
+
+  if (i < changes->len || !hcp_app_model_in_step (model))
+  {
+    g_warning ("Applet rows out of step with the list, reloading them");
+    hcp_app_model_reload (model);
+  }
+}
+
+static void
+hcp_app_model_icon_loaded_cb (HCPIconCache *cache,
+                              const gchar  *name,
+                              gint          size,
+                              HCPAppModel  *model)
+{
+  if (size == model->priv->icon_size)
+    hcp_app_model_drop_icons (model, name);
+}
+
+static void
+hcp_app_model_icon_cache_changed_cb (HCPIconCache *cache,
+                                     HCPAppModel  *model)
+{
+  hcp_app_model_drop_icons (model, NULL);
+}
+
+static GtkTreeModelFlags
+hcp_app_model_get_flags (GtkTreeModel *tree_model)
+{
+  return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint
+hcp_app_model_get_n_columns (GtkTreeModel *tree_model)
+{
+  return HCP_STORE_NUM_COLUMNS;
+}
+
+static GType
+hcp_app_model_get_column_type (GtkTreeModel *tree_model, gint column)
+{
+  switch (column)
+  {
+    case HCP_STORE_ICON:
+      return GDK_TYPE_PIXBUF;
+
+    case HCP_STORE_LABEL:
+      return G_TYPE_STRING;
+
+    case HCP_STORE_APP:
+      return HCP_TYPE_APP;
+
+    default:
+      g_return_val_if_reached (G_TYPE_INVALID);
+  }
+}
+
+static gboolean
+hcp_app_model_get_iter (GtkTreeModel *tree_model,
+                        GtkTreeIter  *iter,
+                        GtkTreePath  *path)
+{
+  if (gtk_tree_path_get_depth (path) != 1)
+    return FALSE;
+
+  return hcp_app_model_find_row (HCP_APP_MODEL (tree_model), iter,
+                                 gtk_tree_path_get_indices (path)[0]);
+}
+
+static GtkTreePath *
+hcp_app_model_get_path (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  HCPAppModel *model = HCP_APP_MODEL (tree_model);
+
+  g_return_val_if_fail (iter->stamp == model->priv->stamp, NULL);
+
+  return gtk_tree_path_new_from_indices (
+      hcp_app_model_get_row (model, ITER_CATEGORY (iter), ITER_POSITION (iter)),
+      -1);
+}
+
+static void
+hcp_app_model_get_value (GtkTreeModel *tree_model,
+                         GtkTreeIter  *iter,
+                         gint          column,
+                         GValue       *value)
+{
+  HCPAppModel *model = HCP_APP_MODEL (tree_model);
+  HCPCategory *category;
+  HCPApp *app;
+
+  g_return_if_fail (iter->stamp == model->priv->stamp);
+  g_return_if_fail (column >= 0 && column < HCP_STORE_NUM_COLUMNS);
+
+  app = hcp_app_model_get_app (model, ITER_CATEGORY (iter), ITER_POSITION (iter));
+
+  g_value_init (value, hcp_app_model_get_column_type (tree_model, column));
+
+  switch (column)
+  {
+    case HCP_STORE_ICON:
+      if (app)
+        g_value_set_object (value, hcp_app_model_get_icon (model, app));
+      break;
+
+    case HCP_STORE_LABEL:
+      /* Both strings outlive the value, gtk_tree_model_get () copies
+       * them out */
+      if (app)
+      {
+        g_value_set_static_string (value, hcp_app_get_display_name (app));
+      }
+      else
+      {
+        category = hcp_app_list_get_category (model->priv->al,
+                                              ITER_CATEGORY (iter));
+
+        if (category)
+          g_value_set_static_string (value, _(category->name));
+      }
+      break;
+
+    case HCP_STORE_APP:
+      g_value_set_object (value, app);
+      break;
+  }
+}
+
+static gboolean
+hcp_app_model_iter_next (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  HCPAppModel *model = HCP_APP_MODEL (tree_model);
+  guint category = ITER_CATEGORY (iter);
+  gint position = ITER_POSITION (iter);
+
+  g_return_val_if_fail (iter->stamp == model->priv->stamp, FALSE);
+
+  if (position + 1 < (gint) hcp_app_model_get_section (model, category)->n_apps)
+  {
+    hcp_app_model_set_iter (model, iter, category, position + 1);
+    return TRUE;
+  }
+
+  for (category++; category < model->priv->sections->len; category++)
+  {
+    HCPAppModelSection *section = hcp_app_model_get_section (model, category);
+
+    if (hcp_app_model_section_rows (section) > 0)
+    {
+      hcp_app_model_set_iter (model, iter, category, section->header ? -1 : 0);
+      return TRUE;
+    }
+  }
+
+  iter->stamp = 0;
+
+  return FALSE;
+}
+
+static gboolean
+hcp_app_model_iter_children (GtkTreeModel *tree_model,
+                             GtkTreeIter  *iter,
+                             GtkTreeIter  *parent)
+{
+  if (parent)
+    return FALSE;
+
+  return hcp_app_model_find_row (HCP_APP_MODEL (tree_model), iter, 0);
+}
+
+static gboolean
+hcp_app_model_iter_has_child (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  return FALSE;
+}
+
+static gint
+hcp_app_model_iter_n_children (GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  HCPAppModel *model = HCP_APP_MODEL (tree_model);
+
+  if (iter)
+    return 0;
+
+  return hcp_app_model_get_offset (model, model->priv->sections->len);
+}
+
+static gboolean
+hcp_app_model_iter_nth_child (GtkTreeModel *tree_model,
+                              GtkTreeIter  *iter,
+                              GtkTreeIter  *parent,
+                              gint          n)
+{
+  if (parent)
+    return FALSE;
+
+  return hcp_app_model_find_row (HCP_APP_MODEL (tree_model), iter, n);
+}
+
+static gboolean
+hcp_app_model_iter_parent (GtkTreeModel *tree_model,
+                           GtkTreeIter  *iter,
+                           GtkTreeIter  *child)
+{
+  return FALSE;
+}
+
+static void
+hcp_app_model_tree_model_init (GtkTreeModelIface *iface)
+{
+  iface->get_flags = hcp_app_model_get_flags;
+  iface->get_n_columns = hcp_app_model_get_n_columns;
+  iface->get_column_type = hcp_app_model_get_column_type;
+  iface->get_iter = hcp_app_model_get_iter;
+  iface->get_path = hcp_app_model_get_path;
+  iface->get_value = hcp_app_model_get_value;
+  iface->iter_next = hcp_app_model_iter_next;
+  iface->iter_children = hcp_app_model_iter_children;
+  iface->iter_has_child = hcp_app_model_iter_has_child;
+  iface->iter_n_children = hcp_app_model_iter_n_children;
+  iface->iter_nth_child = hcp_app_model_iter_nth_child;
+  iface->iter_parent = hcp_app_model_iter_parent;
+}
+
+static void
+hcp_app_model_init (HCPAppModel *model)
+{
+  model->priv = HCP_APP_MODEL_GET_PRIVATE (model);
+
+  model->priv->al = NULL;
+  model->priv->icon_size = 0;
+  model->priv->stamp = g_random_int ();
+  model->priv->n_shown = 0;
+  model->priv->n_offsets = 0;
+  model->priv->sections = g_array_new (FALSE, FALSE,
+                                       sizeof (HCPAppModelSection));
+  model->priv->icons = g_hash_table_new_full (g_direct_hash,
+                                              g_direct_equal,
+                                              NULL,
+                                              g_object_unref);
+}
+
+static void
+hcp_app_model_finalize (GObject *object)
+{
+  HCPAppModelPrivate *priv;
+
+  g_return_if_fail (object);
+  g_return_if_fail (HCP_IS_APP_MODEL (object));
+
+  priv = HCP_APP_MODEL (object)->priv;
+
+  if (priv->al)
+    g_object_unref (priv->al);
+
+  g_array_free (priv->sections, TRUE);
+  g_hash_table_destroy (priv->icons);
+
+  G_OBJECT_CLASS (hcp_app_model_parent_class)->finalize (object);
+}
+
+static void
+hcp_app_model_class_init (HCPAppModelClass *class)
+{
+  GObjectClass *g_object_class = (GObjectClass *) class;
+
+  g_object_class->finalize = hcp_app_model_finalize;
+
+  g_type_class_add_private (g_object_class, sizeof (HCPAppModelPrivate));
+}
+
+HCPAppModel *
+hcp_app_model_new (HCPAppList *al, gint icon_size)
+{
+  HCPAppModel *model;
+
+  g_return_val_if_fail (al, NULL);
+  g_return_val_if_fail (HCP_IS_APP_LIST (al), NULL);
+
+  model = g_object_new (HCP_TYPE_APP_MODEL, NULL);
+
+  model->priv->al = g_object_ref (al);
+  model->priv->icon_size = icon_size;
+
+  /* No rows until hcp_app_model_show_more () */
+  hcp_app_model_add_sections (model);
+
+  g_signal_connect_object (al, "apps-changed",
+                           G_CALLBACK (hcp_app_model_apps_changed_cb),
+                           model, 0);
+
+  g_signal_connect_object (hcp_icon_cache_get_default (), "icon-loaded",
+                           G_CALLBACK (hcp_app_model_icon_loaded_cb),
+                           model, 0);
+
+  g_signal_connect_object (hcp_icon_cache_get_default (), "changed",
+                           G_CALLBACK (hcp_app_model_icon_cache_changed_cb),
+                           model, 0);
+
+  return model;
+}
+
+/* Adds the rows of the next categories, whole categories until at
+ * least min_rows were added. Their icons start loading in the order
+ * of the rows. Returns whether categories are left to show, which
+ * can become true again when the first update of the list adds its
+ * categories. */
+gboolean
+hcp_app_model_show_more (HCPAppModel *model, gint min_rows)
+{
+  HCPAppModelPrivate *priv;
+  gint n_rows = 0;
+
+  g_return_val_if_fail (model, FALSE);
+  g_return_val_if_fail (HCP_IS_APP_MODEL (model), FALSE);
+
+  priv = model->priv;
+
+  while (priv->n_shown < priv->sections->len && n_rows < min_rows)
+  {
+    guint i = priv->n_shown++;
+    HCPCategory *category;
+    guint j, n_apps;
+
+    category = hcp_app_list_get_category (priv->al, i);
+    n_apps = category ? hcp_app_list_category_get_n_apps (category) : 0;
+
+    for (j = 0; j < n_apps; j++)
+    {
+      hcp_app_model_insert_app (model, i, j);
+      hcp_app_model_get_icon (model, hcp_app_list_category_get_app (category, j));
+    }
+
+    n_rows += hcp_app_model_section_rows (hcp_app_model_get_section (model, i));
+  }
+
+  return priv->n_shown < priv->sections->len;
+}
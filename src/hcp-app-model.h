@@ -0,0 +1,74 @@
+/*
+ * This file is part of hildon-control-panel
+ *
+ * Copyright (C) 2010 Nokia Corporation.
+ *
+ * Contact: Karoliina Salminen <karoliina.t.salminen@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef HCP_APP_MODEL_H
+#define HCP_APP_MODEL_H
+
+#include <glib.h>
+#include <glib-object.h>
+#include <gtk/gtk.h>
+
+#include "hcp-app-list.h"
+
+G_BEGIN_DECLS
+
+typedef struct _HCPAppModel HCPAppModel;
+typedef struct _HCPAppModelClass HCPAppModelClass;
+typedef struct _HCPAppModelPrivate HCPAppModelPrivate;
+
+#define HCP_TYPE_APP_MODEL            (hcp_app_model_get_type ())
+#define HCP_APP_MODEL(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), HCP_TYPE_APP_MODEL, HCPAppModel))
+#define HCP_APP_MODEL_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass),  HCP_TYPE_APP_MODEL, HCPAppModelClass))
+#define HCP_IS_APP_MODEL(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), HCP_TYPE_APP_MODEL))
+#define HCP_IS_APP_MODEL_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass),  HCP_TYPE_APP_MODEL))
+#define HCP_APP_MODEL_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj),  HCP_TYPE_APP_MODEL, HCPAppModelClass))
+
+/* A list model with the HCP_STORE_* columns of the grid, read
+ * straight from the categories of an HCPAppList: a header row for
+ * each non-empty category followed by its apps. Nothing is copied,
+ * labels and icons are only looked up for the rows asked for, and
+ * the rows follow "apps-changed" one by one. The model starts empty,
+ * categories are added in order by hcp_app_model_show_more (). */
+struct _HCPAppModel
+{
+  GObject gobject;
+
+  HCPAppModelPrivate *priv;
+};
+
+struct _HCPAppModelClass
+{
+  GObjectClass parent_class;
+};
+
+GType          hcp_app_model_get_type  (void);
+
+HCPAppModel*   hcp_app_model_new       (HCPAppList  *al,
+                                        gint         icon_size);
+
+gboolean       hcp_app_model_show_more (HCPAppModel *model,
+                                        gint         min_rows);
+
+G_END_DECLS
+
+#endif
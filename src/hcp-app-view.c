@@ -30,9 +30,11 @@
 
 #include "hcp-app-view.h"
 #include "hcp-app-list.h"
+#include "hcp-app-model.h"
 #include "hcp-app.h"
 #include "hcp-grid.h"
 #include "hcp-marshalers.h"
+#include "hcp-trace.h"
 #include <hildon/hildon-gtk.h>
 #include <hildon/hildon-helper.h>
 
@@ -58,21 +60,20 @@ enum
 
 struct _HCPAppViewPrivate 
 {
-  GtkWidget   *first_grid;
-};
+  /* A single grid shows all the categories, each non-empty one
+   * starts with a header row. Its HCPAppModel is set at the first
+   * populate. */
+  GtkWidget    *grid;
 
-static GtkListStore*
-hcp_app_view_create_store ()
-{
-  GtkListStore *store;
+  /* Columns the grid is laid out with, 0 until they are set */
+  gint          n_columns;
 
-  store = gtk_list_store_new (HCP_STORE_NUM_COLUMNS, 
-                              GDK_TYPE_PIXBUF, 
-                              G_TYPE_STRING,
-                              G_TYPE_OBJECT); 
+  /* Idle coalescing screen size changes */
+  guint         relayout_id;
 
-  return store;
-}
+  /* Idle adding the categories below the first screen */
+  guint         populate_id;
+};
 
 static GtkWidget*
 hcp_app_view_create_grid ()
@@ -85,24 +86,6 @@ hcp_app_view_create_grid ()
   return grid;
 }
 
-static GtkWidget*
-hcp_app_view_create_separator (const gchar *label)
-{
-  GtkWidget *hbox = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 5);
-  gtk_box_set_homogeneous (GTK_BOX (hbox), FALSE);
-  GtkWidget *separator_1 = gtk_separator_new (GTK_ORIENTATION_HORIZONTAL);
-  GtkWidget *separator_2 = gtk_separator_new (GTK_ORIENTATION_HORIZONTAL);
-  GtkWidget *label_1 = gtk_label_new (label);
-
-  gtk_widget_set_name (separator_1, "hildon-control-panel-separator");
-  gtk_widget_set_name (separator_2, "hildon-control-panel-separator");
-  gtk_box_pack_start (GTK_BOX(hbox), separator_1, TRUE, TRUE, 0);
-  gtk_box_pack_start (GTK_BOX(hbox), label_1, FALSE, FALSE, 5);
-  gtk_box_pack_start (GTK_BOX(hbox), separator_2, TRUE, TRUE, 0);
-
-  return hbox;
-}
-
 static HCPApp *
 hcp_app_view_get_selected_app (GtkWidget *widget, GtkTreePath *path)
 {
@@ -112,10 +95,10 @@ hcp_app_view_get_selected_app (GtkWidget *widget, GtkTreePath *path)
   gint item_pos;
 
   g_return_val_if_fail (widget, NULL);
-  g_return_val_if_fail (GTK_IS_ICON_VIEW (widget), NULL);
+  g_return_val_if_fail (HCP_IS_GRID (widget), NULL);
   g_return_val_if_fail (path, NULL);
 
-  model = gtk_icon_view_get_model (GTK_ICON_VIEW (widget));
+  model = hcp_grid_get_model (HCP_GRID (widget));
 
   if (path == NULL) return NULL;
 
@@ -148,124 +131,155 @@ hcp_app_view_launch_app (GtkWidget *widget,
     hcp_app_launch (app, TRUE);
 }
 
-static void
-hcp_app_view_add_app (HCPApp *app, HCPGrid *grid)
+static HCPApp *
+hcp_app_view_get_row_app (GtkTreeModel *model, GtkTreeIter *iter)
 {
-  GtkTreeModel *store;
-  GtkTreePath *path;
-  GtkTreeIter iter;
-  gchar *name = NULL;
-  gchar *text_domain = NULL;
-
-  store = gtk_icon_view_get_model (GTK_ICON_VIEW (grid));
-
-  g_object_get (G_OBJECT (app),
-                "name", &name,
-                "text-domain", &text_domain,
-                NULL); 
-
-  gtk_list_store_append (GTK_LIST_STORE (store), &iter);
-
-  gtk_list_store_set (GTK_LIST_STORE (store), &iter, 
-                      HCP_STORE_LABEL, ((text_domain && *text_domain) ? 
-			                dgettext(text_domain, name) : _(name)),
-                      HCP_STORE_APP, app,
-                      -1);
+  HCPApp *app = NULL;
 
-  path = gtk_tree_model_get_path (GTK_TREE_MODEL (store), &iter);
+  gtk_tree_model_get (model, iter, HCP_STORE_APP, &app, -1);
 
-  g_object_set (G_OBJECT (app),
-                "grid", grid,
-                "item-pos", gtk_tree_path_get_indices (path) [0],
-                NULL);
+  /* The app list keeps its own reference */
+  if (app)
+    g_object_unref (app);
 
-  gtk_tree_path_free (path);
-
-  g_free (name);
+  return app;
 }
 
+/* Tells each app from row first on where its row is, for
+ * hcp_app_focus () */
 static void
-hcp_app_view_add_category (HCPCategory *category, HCPAppView *view)
+hcp_app_view_update_positions (HCPAppView *view, gint first)
 {
-  /* If a group has items */
-  if (category->apps)
-  {
-    GtkWidget *grid, *separator;
-    GtkListStore *store;
-    GList *focus_chain = NULL;
-
-    grid = hcp_app_view_create_grid ();
-    store = hcp_app_view_create_store ();
-
-    g_signal_connect (grid, "item-activated",
-                      G_CALLBACK (hcp_app_view_launch_app),
-                      NULL);
-  
-    /* If we are creating a group with a defined name, we use
-     * it in the separator */
-    separator = hcp_app_view_create_separator (_(category->name));
-
-    gtk_box_pack_start (GTK_BOX (view), separator, FALSE, FALSE, 0);
-	gtk_box_pack_start (GTK_BOX (view), GTK_WIDGET(grid), FALSE, FALSE, 0);
-
-    gtk_container_get_focus_chain (GTK_CONTAINER (view), &focus_chain);
-    focus_chain = g_list_append (focus_chain, grid);
-    gtk_container_set_focus_chain (GTK_CONTAINER (view), focus_chain);
-    g_list_free (focus_chain);
+  GtkTreeModel *model = hcp_grid_get_model (HCP_GRID (view->priv->grid));
+  GtkTreeIter iter;
+  gboolean valid;
+  gint pos = first;
 
-    gtk_icon_view_set_model (GTK_ICON_VIEW (grid), 
-                             GTK_TREE_MODEL (store));
+  valid = gtk_tree_model_iter_nth_child (model, &iter, NULL, first);
 
-    g_slist_foreach (category->apps,
-                     (GFunc) hcp_app_view_add_app,
-                     grid);
+  while (valid)
+  {
+    HCPApp *app = hcp_app_view_get_row_app (model, &iter);
 
-    hcp_grid_refresh_icons (HCP_GRID(grid));
+    if (app)
+      g_object_set (G_OBJECT (app),
+                    "grid", view->priv->grid,
+                    "item-pos", pos,
+                    NULL);
 
-    /* first group */
-    if (!view->priv->first_grid)
-      view->priv->first_grid = grid;
+    valid = gtk_tree_model_iter_next (model, &iter);
+    pos++;
   }
 }
 
 static void
-hcp_app_view_set_n_columns  (GtkWidget      *widget,
-                             gpointer        data)
+hcp_app_view_set_n_columns  (HCPAppView     *view,
+                             gint            n_columns)
 {
-    gint n_columns;
 /* 4px is the HCP_GRID_X_PADDING */
 #define PORTRAIT_WIDTH   480      - 3 * HILDON_MARGIN_DOUBLE
 #define LANDSCAPE_WIDTH (800 / 2) - 2 * HILDON_MARGIN_DOUBLE
 
-    if (! HCP_IS_GRID (widget))
-        return;
-
-    n_columns = GPOINTER_TO_INT (data);
-
 /*
  * g_debug ("WIDTH = %d", (n_columns == 1) ? PORTRAIT_WIDTH : LANDSCAPE_WIDTH);
  */
 
     /* grid view, set proper no. of colunms */
-    gtk_icon_view_set_columns (GTK_ICON_VIEW (widget), n_columns);
-    gtk_icon_view_set_item_width (GTK_ICON_VIEW (widget),
-                                  (n_columns == 1) ? 
-                                   PORTRAIT_WIDTH : 
-                                   LANDSCAPE_WIDTH);
-    hcp_grid_refresh_icons (HCP_GRID (widget));
+    hcp_grid_set_columns (HCP_GRID (view->priv->grid),
+                          n_columns,
+                          (n_columns == 1) ? 
+                           PORTRAIT_WIDTH : 
+                           LANDSCAPE_WIDTH);
 }
 
+/* Only the layout changes with the orientation, the grid keeps the
+ * pixbufs and queues its own resize */
 static void
-hcp_app_view_size_changed   (GdkScreen          *screen,
-                             HCPAppView         *view)
+hcp_app_view_update_columns (HCPAppView *view)
 {
     gint    columns = 2;
-    if (gdk_screen_get_width (screen) < 800)
+    if (gdk_screen_get_width (DEF_SCREEN) < 800)
         columns = 1;
 
-    gtk_container_foreach (GTK_CONTAINER (view),
-                           hcp_app_view_set_n_columns, 
-                           GINT_TO_POINTER (columns));
+    if (columns == view->priv->n_columns)
+        return;
+
+    view->priv->n_columns = columns;
+
+    hcp_app_view_set_n_columns (view, columns);
+}
+
+static gboolean
+hcp_app_view_relayout (HCPAppView *view)
+{
+  view->priv->relayout_id = 0;
+
+  hcp_app_view_update_columns (view);
+
+  return FALSE;
+}
+
+static void
+hcp_app_view_size_changed   (GdkScreen          *screen,
+                             HCPAppView         *view)
+{
+  /* A rotation can come as several size changes, lay out once
+   * before the next redraw */
+  if (view->priv->relayout_id == 0)
+    view->priv->relayout_id =
+        g_idle_add_full (G_PRIORITY_HIGH_IDLE,
+                         (GSourceFunc) hcp_app_view_relayout,
+                         view,
+                         NULL);
+}
+
+/* Rows filling the screen, counting headers as items */
+static gint
+hcp_app_view_get_screen_rows (HCPAppView *view)
+{
+  return (gdk_screen_get_height (DEF_SCREEN) / HCP_GRID_ITEM_HEIGHT + 1) *
+         MAX (view->priv->n_columns, 1);
+}
+
+static gboolean hcp_app_view_populate_more (HCPAppView *view);
+
+/* Shows a screenful of the categories not shown yet at once, the
+ * other ones from idles */
+static void
+hcp_app_view_show_categories (HCPAppView *view, HCPAppModel *model)
+{
+  if (view->priv->populate_id != 0)
+    return;
+
+  if (hcp_app_model_show_more (model, hcp_app_view_get_screen_rows (view)))
+    view->priv->populate_id =
+        g_idle_add_full (G_PRIORITY_LOW,
+                         (GSourceFunc) hcp_app_view_populate_more,
+                         view,
+                         NULL);
+}
+
+static gboolean
+hcp_app_view_populate_more (HCPAppView *view)
+{
+  GtkTreeModel *model = hcp_grid_get_model (HCP_GRID (view->priv->grid));
+  gint n_rows = gtk_tree_model_iter_n_children (model, NULL);
+  gboolean more;
+
+  hcp_trace_begin ("populate_more", NULL);
+
+  /* A category at a time, input is handled in between */
+  more = hcp_app_model_show_more (HCP_APP_MODEL (model), 1);
+
+  /* Rows are only ever added below the ones shown */
+  hcp_app_view_update_positions (view, n_rows);
+
+  hcp_trace_end ("populate_more");
+
+  if (!more)
+    view->priv->populate_id = 0;
+
+  return more;
 }
 
 static void
@@ -273,14 +287,31 @@ hcp_app_view_init (HCPAppView *view)
 {
   view->priv = HCP_APP_VIEW_GET_PRIVATE (view);
 
-  view->priv->first_grid = NULL;
+  view->priv->n_columns = 0;
+  view->priv->relayout_id = 0;
+  view->priv->populate_id = 0;
+
+  view->priv->grid = hcp_app_view_create_grid ();
+
+  g_signal_connect (view->priv->grid, "item-activated",
+                    G_CALLBACK (hcp_app_view_launch_app),
+                    NULL);
+
+  gtk_box_pack_start (GTK_BOX (view), view->priv->grid, TRUE, TRUE, 0);
+  gtk_widget_show (view->priv->grid);
 
   /* Connect to screen size changes in order to receive
    * the orientation changes */
-  g_signal_connect (DEF_SCREEN,
-                    "size-changed",
-                    G_CALLBACK (hcp_app_view_size_changed),
-                    view);
+  g_signal_connect_object (DEF_SCREEN,
+                           "size-changed",
+                           G_CALLBACK (hcp_app_view_size_changed),
+                           view, 0);
+
+  /*
+   * Init columns in the grid with the proper number
+   * (accoording to the current orientation)
+   */
+  hcp_app_view_update_columns (view);
 
   g_object_set (G_OBJECT (view), 
                 "homogeneous", FALSE,
@@ -288,6 +319,25 @@ hcp_app_view_init (HCPAppView *view)
                 NULL);
 }
 
+static void
+hcp_app_view_finalize (GObject *object)
+{
+  HCPAppViewPrivate *priv;
+
+  g_return_if_fail (object);
+  g_return_if_fail (HCP_IS_APP_VIEW (object));
+
+  priv = HCP_APP_VIEW (object)->priv;
+
+  if (priv->relayout_id)
+    g_source_remove (priv->relayout_id);
+
+  if (priv->populate_id)
+    g_source_remove (priv->populate_id);
+
+  G_OBJECT_CLASS (hcp_app_view_parent_class)->finalize (object);
+}
+
 static void
 hcp_app_view_get_property (GObject    *gobject,
                            guint       prop_id,
@@ -321,6 +371,8 @@ hcp_app_view_class_init (HCPAppViewClass *class)
 {
   GObjectClass *g_object_class = (GObjectClass *) class;
 
+  g_object_class->finalize = hcp_app_view_finalize;
+
   g_object_class->get_property = hcp_app_view_get_property;
   g_object_class->set_property = hcp_app_view_set_property;
 
@@ -348,36 +400,60 @@ hcp_app_view_new (void)
 void
 hcp_app_view_populate (HCPAppView *view, HCPAppList *al)
 {
-  HCPAppViewPrivate *priv;
-  GSList *categories = NULL;
+  HCPAppModel *model;
 
   g_return_if_fail (view);
   g_return_if_fail (HCP_IS_APP_VIEW (view));
   g_return_if_fail (al);
   g_return_if_fail (HCP_IS_APP_LIST (al));
 
-  priv = view->priv;
+  /* The model follows the list by itself from then on */
+  if (hcp_grid_get_model (HCP_GRID (view->priv->grid)) == NULL)
+  {
+    model = hcp_app_model_new (al, HCP_ICON_SIZE);
+    hcp_grid_set_model (HCP_GRID (view->priv->grid), GTK_TREE_MODEL (model));
 
-  g_object_get (G_OBJECT (al),
-                "categories", &categories,
-                NULL);
+    /* Only the first screen is there for the first frame, the
+     * other categories come once the window is up */
+    hcp_app_view_show_categories (view, model);
 
-  gtk_container_foreach (GTK_CONTAINER (view),
-                         (GtkCallback) gtk_widget_destroy,
-                         NULL);
+    g_object_unref (model);
+  }
+
+  hcp_app_view_update_positions (view, 0);
+}
+
+/* To be called once the model replayed changes, it only has to
+ * move the apps to their new rows */
+void
+hcp_app_view_apply_changes (HCPAppView *view,
+                            HCPAppList *al,
+                            GArray     *changes)
+{
+  GtkTreeModel *model;
+  guint i;
 
-  priv->first_grid = NULL;
+  g_return_if_fail (view);
+  g_return_if_fail (HCP_IS_APP_VIEW (view));
+  g_return_if_fail (changes);
 
-  gtk_container_set_focus_chain (GTK_CONTAINER (view), NULL);
+  model = hcp_grid_get_model (HCP_GRID (view->priv->grid));
 
-  g_slist_foreach (categories,
-                   (GFunc) hcp_app_view_add_category,
-                   view);
+  if (model == NULL)
+    return;
 
-  /*
-   * Init columns in grids with the proper number
-   * (accoording to the current orientation)
-   */
-  hcp_app_view_size_changed (DEF_SCREEN, view);
-}
+  /* Apps that went to a category not shown yet have no row until
+   * it is, hcp_app_focus () leaves them alone */
+  for (i = 0; i < changes->len; i++)
+  {
+    HCPAppChange *change = &g_array_index (changes, HCPAppChange, i);
+
+    if (change->type != HCP_APP_CHANGE_REMOVED)
+      g_object_set (G_OBJECT (change->app), "item-pos", -1, NULL);
+  }
+
+  /* The view may have been populated before the first update */
+  hcp_app_view_show_categories (view, HCP_APP_MODEL (model));
 
+  hcp_app_view_update_positions (view, 0);
+}
@@ -65,6 +65,10 @@ GtkWidget*   hcp_app_view_new             (void);
 void         hcp_app_view_populate        (HCPAppView *view,
                                            HCPAppList *al);
 
+void         hcp_app_view_apply_changes   (HCPAppView *view,
+                                           HCPAppList *al,
+                                           GArray     *changes);
+
 
 G_END_DECLS
 
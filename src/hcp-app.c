@@ -27,6 +27,7 @@
 #endif
 
 #include <dlfcn.h>
+#include <locale.h>
 #include <string.h>
 
 #include <glib.h>
@@ -35,6 +36,7 @@
 
 #include "hcp-program.h"
 #include "hcp-app.h"
+#include "hcp-grid.h"
 
 #define HCP_APP_GET_PRIVATE(object) \
         (G_TYPE_INSTANCE_GET_PRIVATE ((object), HCP_TYPE_APP, HCPAppPrivate))
@@ -51,20 +53,30 @@ enum
   PROP_GRID,
   PROP_ITEM_POS,
   PROP_SUGGESTED_POS,
-  PROP_TEXT_DOMAIN
+  PROP_TEXT_DOMAIN,
+  PROP_DISPLAY_NAME
 };
 
-struct _HCPAppPrivate 
+/* Every listed applet has an HCPApp, not only those the UI or RPC
+ * asks for: the categories, the "apps-changed" steps and the model
+ * all hold HCPApp pointers. What keeps it small is that its strings
+ * are the interned ones of its entry, shared with the other apps and
+ * never copied, and that the display name, its collation key and the
+ * plugin module are only made when first needed. */
+struct _HCPAppPrivate
 {
-    gchar                   *name;
-    gchar                   *plugin;
-    gchar                   *icon;
-    gchar                   *category;
+    const gchar             *name;
+    const gchar             *plugin;
+    const gchar             *icon;
+    const gchar             *category;
     gboolean                 is_running;
     GtkWidget               *grid;
     gint                     item_pos;
     gint                     sugg_pos;
-    gchar                   *text_domain;
+    const gchar             *text_domain;
+    gchar                   *display_name;
+    gchar                   *collate_key;
+    guint                    locale_serial;
     void                    *handle;
     hcp_plugin_exec_f       *exec;
     hcp_plugin_save_state_f *save_state;
@@ -76,6 +88,11 @@ typedef struct _PluginLaunchData
   gboolean    user_activated;
 } PluginLaunchData;
 
+/* The locale the display names are translated and collated for,
+ * see hcp_app_check_locale () */
+static const gchar *hcp_app_locale = NULL;
+static guint hcp_app_locale_serial = 0;
+
 #define HCP_PLUGIN_EXEC_SYMBOL        "execute"
 #define HCP_PLUGIN_SAVE_STATE_SYMBOL  "save_state"
 
@@ -92,10 +109,48 @@ hcp_app_init (HCPApp *app)
   app->priv->grid = NULL;
   app->priv->item_pos = -1;
   app->priv->text_domain = NULL;
+  app->priv->display_name = NULL;
+  app->priv->collate_key = NULL;
+  app->priv->locale_serial = 0;
   app->priv->save_state = NULL;
   app->priv->sugg_pos = G_MAXINT;
 }
 
+/* The translated name and its collation key are only computed when
+ * first needed, and again after the name, the text domain or the
+ * locale changed */
+static void
+hcp_app_reset_display_name (HCPApp *app)
+{
+  g_free (app->priv->display_name);
+  app->priv->display_name = NULL;
+
+  g_free (app->priv->collate_key);
+  app->priv->collate_key = NULL;
+}
+
+static void
+hcp_app_ensure_display_name (HCPApp *app)
+{
+  HCPAppPrivate *priv = app->priv;
+
+  if (priv->name == NULL)
+    return;
+
+  if (priv->display_name != NULL &&
+      priv->locale_serial == hcp_app_locale_serial)
+    return;
+
+  hcp_app_reset_display_name (app);
+
+  priv->locale_serial = hcp_app_locale_serial;
+  priv->display_name = g_strdup ((priv->text_domain && *priv->text_domain) ?
+                                 dgettext (priv->text_domain, priv->name) :
+                                 _(priv->name));
+
+  priv->collate_key = g_utf8_collate_key (priv->display_name, -1);
+}
+
 static void
 hcp_app_load (HCPApp *app)
 {
@@ -238,41 +293,13 @@ hcp_app_finalize (GObject *object)
   app = HCP_APP (object);
   priv = app->priv;
 
-  if (priv->name != NULL) 
-  {
-    g_free (priv->name);
-    priv->name = NULL;
-  }
-
-  if (priv->plugin != NULL) 
-  {
-    g_free (priv->plugin);
-    priv->plugin = NULL;
-  }
-
-  if (priv->icon != NULL) 
-  {
-    g_free (priv->icon);
-    priv->icon = NULL;
-  }
-
-  if (priv->category != NULL) 
-  {
-    g_free (priv->category);
-    priv->category = NULL;
-  }
-
   if (priv->grid != NULL) 
   {
     g_object_unref (priv->grid);
     priv->grid = NULL;
   }
 
-  if (priv->text_domain != NULL) 
-  {
-    g_free (priv->text_domain);
-    priv->text_domain = NULL;
-  }
+  hcp_app_reset_display_name (app);
 
   G_OBJECT_CLASS (hcp_app_parent_class)->finalize (object);
 }
@@ -325,6 +352,10 @@ hcp_app_get_property (GObject    *gobject,
       g_value_set_string (value, priv->text_domain);
       break;
 
+    case PROP_DISPLAY_NAME:
+      g_value_set_string (value, hcp_app_get_display_name (HCP_APP (gobject)));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (gobject, prop_id, pspec);
       break;
@@ -343,24 +374,23 @@ hcp_app_set_property (GObject      *gobject,
   
   switch (prop_id)
   {
+    /* All the strings are interned, as in HCPDesktopEntry; the apps
+     * made from entries share them with the entries */
     case PROP_NAME:
-      g_free (priv->name);
-      priv->name = g_strdup (g_value_get_string (value));
+      priv->name = g_intern_string (g_value_get_string (value));
+      hcp_app_reset_display_name (HCP_APP (gobject));
       break;
 
     case PROP_PLUGIN:
-      g_free (priv->plugin);
-      priv->plugin = g_strdup (g_value_get_string (value));
+      priv->plugin = g_intern_string (g_value_get_string (value));
       break;
 
     case PROP_ICON:
-      g_free (priv->icon);
-      priv->icon = g_strdup (g_value_get_string (value));
+      priv->icon = g_intern_string (g_value_get_string (value));
       break;
 
     case PROP_CATEGORY:
-      g_free (priv->category);
-      priv->category = g_strdup (g_value_get_string (value));
+      priv->category = g_intern_string (g_value_get_string (value));
       break;
 
     case PROP_IS_RUNNING:
@@ -382,8 +412,8 @@ hcp_app_set_property (GObject      *gobject,
       break;
 
     case PROP_TEXT_DOMAIN:
-      g_free (priv->text_domain);
-      priv->text_domain = g_strdup (g_value_get_string (value));
+      priv->text_domain = g_intern_string (g_value_get_string (value));
+      hcp_app_reset_display_name (HCP_APP (gobject));
       break;
 
     default:
@@ -456,7 +486,7 @@ hcp_app_class_init (HCPAppClass *class)
                                                      "Item position",
                                                      "Application position inside the grid",
                                                      -1,
-                                                     100,
+                                                     G_MAXINT,
                                                      -1,
                                                       (G_PARAM_READABLE | G_PARAM_WRITABLE)));
 
@@ -477,6 +507,14 @@ hcp_app_class_init (HCPAppClass *class)
                                                         "Set app's text domain",
                                                         NULL,
                                                         (G_PARAM_READABLE | G_PARAM_WRITABLE)));
+
+  g_object_class_install_property (g_object_class,
+                                   PROP_DISPLAY_NAME,
+                                   g_param_spec_string ("display-name",
+                                                        "Display Name",
+                                                        "App's name translated in its text domain",
+                                                        NULL,
+                                                        G_PARAM_READABLE));
  
   g_type_class_add_private (g_object_class, sizeof (HCPAppPrivate));
 }
@@ -489,6 +527,77 @@ hcp_app_new ()
   return app;
 }
 
+/* Same as hcp_app_new () followed by setting the properties, without
+ * going through GValues for each one of them. The strings of an
+ * HCPDesktopEntry are interned already and are kept as they are. */
+GObject *
+hcp_app_new_full (const gchar *name,
+                  const gchar *plugin,
+                  const gchar *icon,
+                  const gchar *category,
+                  const gchar *text_domain,
+                  gint         suggested_pos)
+{
+  HCPApp *app = g_object_new (HCP_TYPE_APP, NULL);
+  HCPAppPrivate *priv = app->priv;
+
+  priv->name = g_intern_string (name);
+  priv->plugin = g_intern_string (plugin);
+  priv->icon = g_intern_string (icon);
+  priv->category = g_intern_string (category);
+  priv->text_domain = g_intern_string (text_domain);
+  priv->sugg_pos = suggested_pos;
+
+  return G_OBJECT (app);
+}
+
+/* Applies the fields of a changed .desktop file, keeping the loaded
+ * plugin and the running state. Returns TRUE if the name or icon
+ * shown for the app changed. */
+gboolean
+hcp_app_update (HCPApp      *app,
+                const gchar *name,
+                const gchar *icon,
+                const gchar *category,
+                const gchar *text_domain,
+                gint         suggested_pos)
+{
+  HCPAppPrivate *priv;
+  gboolean changed = FALSE;
+
+  g_return_val_if_fail (app, FALSE);
+  g_return_val_if_fail (HCP_IS_APP (app), FALSE);
+
+  priv = app->priv;
+
+  /* Interned, comparing the pointers is enough */
+  if (priv->name != g_intern_string (name))
+  {
+    priv->name = g_intern_string (name);
+    hcp_app_reset_display_name (app);
+    changed = TRUE;
+  }
+
+  if (priv->icon != g_intern_string (icon))
+  {
+    priv->icon = g_intern_string (icon);
+    changed = TRUE;
+  }
+
+  priv->category = g_intern_string (category);
+
+  if (priv->text_domain != g_intern_string (text_domain))
+  {
+    priv->text_domain = g_intern_string (text_domain);
+    hcp_app_reset_display_name (app);
+    changed = TRUE;
+  }
+
+  priv->sugg_pos = suggested_pos;
+
+  return changed;
+}
+
 void
 hcp_app_launch (HCPApp *app, gboolean user_activated)
 {
@@ -524,13 +633,14 @@ hcp_app_focus (HCPApp *app)
 
   priv = app->priv;
 
-  if (priv->grid) 
+  /* No row yet while the view is still being filled */
+  if (priv->grid && priv->item_pos >= 0)
   {
     GtkTreePath *path;
 
     gtk_widget_grab_focus (priv->grid);
     path = gtk_tree_path_new_from_indices (priv->item_pos, -1);
-    gtk_icon_view_select_path (GTK_ICON_VIEW (priv->grid), path);
+    hcp_grid_select_path (HCP_GRID (priv->grid), path);
     gtk_tree_path_free (path);
   }
 }
@@ -576,15 +686,116 @@ hcp_app_can_save_state (HCPApp *app)
   return (priv->save_state != NULL);
 }
 
+/* What the translations and the collation depend on; interned */
+static const gchar *
+hcp_app_get_locale (void)
+{
+  const gchar *messages = setlocale (LC_MESSAGES, NULL);
+  const gchar *collate = setlocale (LC_COLLATE, NULL);
+  const gchar *language = g_getenv ("LANGUAGE");
+  gchar *locale;
+  const gchar *ret;
+
+  locale = g_strconcat (messages ? messages : "", ";",
+                        collate ? collate : "", ";",
+                        language ? language : "",
+                        NULL);
+
+  ret = g_intern_string (locale);
+  g_free (locale);
+
+  return ret;
+}
+
+/* Looks whether the locale changed since the last call. If it did,
+ * the display names of all the apps are computed again when next
+ * needed, and the caller is to sort them again. Main thread only. */
+gboolean
+hcp_app_check_locale (void)
+{
+  const gchar *locale = hcp_app_get_locale ();
+  gboolean changed;
+
+  if (locale == hcp_app_locale)
+    return FALSE;
+
+  changed = (hcp_app_locale != NULL);
+
+  hcp_app_locale = locale;
+  hcp_app_locale_serial++;
+
+  return changed;
+}
+
+const gchar *
+hcp_app_get_display_name (HCPApp *app)
+{
+  g_return_val_if_fail (app, NULL);
+  g_return_val_if_fail (HCP_IS_APP (app), NULL);
+
+  hcp_app_ensure_display_name (app);
+
+  return app->priv->display_name;
+}
+
+/* The hcp_app_peek_* () functions return the app's own strings,
+ * which are only valid until the property is set again */
+const gchar *
+hcp_app_peek_name (HCPApp *app)
+{
+  g_return_val_if_fail (app, NULL);
+  g_return_val_if_fail (HCP_IS_APP (app), NULL);
+
+  return app->priv->name;
+}
+
+const gchar *
+hcp_app_peek_plugin (HCPApp *app)
+{
+  g_return_val_if_fail (app, NULL);
+  g_return_val_if_fail (HCP_IS_APP (app), NULL);
+
+  return app->priv->plugin;
+}
+
+const gchar *
+hcp_app_peek_icon (HCPApp *app)
+{
+  g_return_val_if_fail (app, NULL);
+  g_return_val_if_fail (HCP_IS_APP (app), NULL);
+
+  return app->priv->icon;
+}
+
+const gchar *
+hcp_app_peek_category (HCPApp *app)
+{
+  g_return_val_if_fail (app, NULL);
+  g_return_val_if_fail (HCP_IS_APP (app), NULL);
+
+  return app->priv->category;
+}
+
+const gchar *
+hcp_app_peek_text_domain (HCPApp *app)
+{
+  g_return_val_if_fail (app, NULL);
+  g_return_val_if_fail (HCP_IS_APP (app), NULL);
+
+  return app->priv->text_domain;
+}
+
 gint
 hcp_app_sort_func (const HCPApp *a, const HCPApp *b)
 {
   g_return_val_if_fail (a && b, 0);
 
   /* sort by position or translated name (if position is equal) */
-  gint ret = a->priv->sugg_pos != b->priv->sugg_pos ? \
-             (a->priv->sugg_pos < b->priv->sugg_pos ? -1 : 1) : \
-             strcmp (_(a->priv->name), _(b->priv->name));
+  if (a->priv->sugg_pos != b->priv->sugg_pos)
+    return a->priv->sugg_pos < b->priv->sugg_pos ? -1 : 1;
 
-  return ret;
+  hcp_app_ensure_display_name ((HCPApp *) a);
+  hcp_app_ensure_display_name ((HCPApp *) b);
+
+  return g_strcmp0 (a->priv->collate_key, b->priv->collate_key);
 }
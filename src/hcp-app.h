@@ -67,6 +67,20 @@ GType        hcp_app_get_type       (void);
 
 GObject*     hcp_app_new            (void);
 
+GObject*     hcp_app_new_full       (const gchar *name,
+                                     const gchar *plugin,
+                                     const gchar *icon,
+                                     const gchar *category,
+                                     const gchar *text_domain,
+                                     gint         suggested_pos);
+
+gboolean     hcp_app_update         (HCPApp      *app,
+                                     const gchar *name,
+                                     const gchar *icon,
+                                     const gchar *category,
+                                     const gchar *text_domain,
+                                     gint         suggested_pos);
+
 void         hcp_app_launch         (HCPApp   *app, 
                                      gboolean  user_activated);
 
@@ -78,6 +92,20 @@ gboolean     hcp_app_is_running     (HCPApp   *app);
 
 gboolean     hcp_app_can_save_state (HCPApp   *app);
 
+const gchar* hcp_app_get_display_name (HCPApp  *app);
+
+gboolean     hcp_app_check_locale     (void);
+
+const gchar* hcp_app_peek_name        (HCPApp  *app);
+
+const gchar* hcp_app_peek_plugin      (HCPApp  *app);
+
+const gchar* hcp_app_peek_icon        (HCPApp  *app);
+
+const gchar* hcp_app_peek_category    (HCPApp  *app);
+
+const gchar* hcp_app_peek_text_domain (HCPApp  *app);
+
 gint         hcp_app_sort_func      (const HCPApp *a, 
                                      const HCPApp *b);
 
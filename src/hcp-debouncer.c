@@ -0,0 +1,324 @@
+/*
+ * This file is part of hildon-control-panel
+ *
+ * Copyright (C) 2010 Nokia Corporation.
+ *
+ * Contact: Karoliina Salminen <karoliina.t.salminen@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "hcp-debouncer.h"
+
+#define HCP_DEBOUNCER_GET_PRIVATE(object) \
+        (G_TYPE_INSTANCE_GET_PRIVATE ((object), HCP_TYPE_DEBOUNCER, HCPDebouncerPrivate))
+
+G_DEFINE_TYPE (HCPDebouncer, hcp_debouncer, G_TYPE_OBJECT);
+
+typedef enum
+{
+  SIGNAL_FLUSH,
+  N_SIGNALS
+} HCPDebouncerSignals;
+
+static gint signals[N_SIGNALS];
+
+enum
+{
+  PROP_0,
+  PROP_EVENTS_RECEIVED,
+  PROP_FLUSHES
+};
+
+/*
+ * Every queued path restarts a quiet period timer; the batch is
+ * flushed once no event arrived for that long. While events keep
+ * coming in the quiet period doubles up to quiet_max, and shrinks
+ * again after calm batches. The max_latency timer, started by the
+ * first event of a batch, bounds how stale the batch can get.
+ */
+struct _HCPDebouncerPrivate
+{
+  GHashTable *paths;
+
+  guint       quiet_min;
+  guint       quiet_max;
+  guint       max_latency;
+  guint       quiet;
+
+  guint       quiet_id;
+  guint       latency_id;
+
+  guint       batch_events;
+  guint       events_received;
+  guint       flushes;
+};
+
+static gboolean
+hcp_debouncer_quiet_timeout (HCPDebouncer *debouncer)
+{
+  debouncer->priv->quiet_id = 0;
+
+  hcp_debouncer_flush (debouncer);
+
+  return FALSE;
+}
+
+static gboolean
+hcp_debouncer_latency_timeout (HCPDebouncer *debouncer)
+{
+  debouncer->priv->latency_id = 0;
+
+  hcp_debouncer_flush (debouncer);
+
+  return FALSE;
+}
+
+static void
+hcp_debouncer_remove_sources (HCPDebouncer *debouncer)
+{
+  HCPDebouncerPrivate *priv = debouncer->priv;
+
+  if (priv->quiet_id)
+  {
+    g_source_remove (priv->quiet_id);
+    priv->quiet_id = 0;
+  }
+
+  if (priv->latency_id)
+  {
+    g_source_remove (priv->latency_id);
+    priv->latency_id = 0;
+  }
+}
+
+static void
+hcp_debouncer_init (HCPDebouncer *debouncer)
+{
+  debouncer->priv = HCP_DEBOUNCER_GET_PRIVATE (debouncer);
+
+  debouncer->priv->paths = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                  g_free, NULL);
+  debouncer->priv->quiet_min = 0;
+  debouncer->priv->quiet_max = 0;
+  debouncer->priv->max_latency = 0;
+  debouncer->priv->quiet = 0;
+  debouncer->priv->quiet_id = 0;
+  debouncer->priv->latency_id = 0;
+  debouncer->priv->batch_events = 0;
+  debouncer->priv->events_received = 0;
+  debouncer->priv->flushes = 0;
+}
+
+static void
+hcp_debouncer_finalize (GObject *object)
+{
+  HCPDebouncer *debouncer;
+
+  g_return_if_fail (object);
+  g_return_if_fail (HCP_IS_DEBOUNCER (object));
+
+  debouncer = HCP_DEBOUNCER (object);
+
+  hcp_debouncer_remove_sources (debouncer);
+
+  g_hash_table_destroy (debouncer->priv->paths);
+
+  G_OBJECT_CLASS (hcp_debouncer_parent_class)->finalize (object);
+}
+
+static void
+hcp_debouncer_get_property (GObject    *gobject,
+                            guint      prop_id,
+                            GValue     *value,
+                            GParamSpec *pspec)
+{
+  HCPDebouncerPrivate *priv;
+
+  priv = HCP_DEBOUNCER (gobject)->priv;
+
+  switch (prop_id)
+  {
+    case PROP_EVENTS_RECEIVED:
+      g_value_set_uint (value, priv->events_received);
+      break;
+
+    case PROP_FLUSHES:
+      g_value_set_uint (value, priv->flushes);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (gobject, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+hcp_debouncer_class_init (HCPDebouncerClass *class)
+{
+  GObjectClass *g_object_class = (GObjectClass *) class;
+
+  g_object_class->finalize = hcp_debouncer_finalize;
+
+  g_object_class->get_property = hcp_debouncer_get_property;
+
+  signals[SIGNAL_FLUSH] =
+        g_signal_new ("flush",
+                      G_OBJECT_CLASS_TYPE (g_object_class),
+                      G_SIGNAL_RUN_FIRST,
+                      G_STRUCT_OFFSET (HCPDebouncerClass, flush),
+                      NULL, NULL,
+                      g_cclosure_marshal_VOID__POINTER,
+                      G_TYPE_NONE, 1,
+                      G_TYPE_POINTER);
+
+  g_object_class_install_property (g_object_class,
+                                   PROP_EVENTS_RECEIVED,
+                                   g_param_spec_uint ("events-received",
+                                                      "Events received",
+                                                      "Number of paths queued so far",
+                                                      0,
+                                                      G_MAXUINT,
+                                                      0,
+                                                      G_PARAM_READABLE));
+
+  g_object_class_install_property (g_object_class,
+                                   PROP_FLUSHES,
+                                   g_param_spec_uint ("flushes",
+                                                      "Flushes",
+                                                      "Number of batches flushed so far",
+                                                      0,
+                                                      G_MAXUINT,
+                                                      0,
+                                                      G_PARAM_READABLE));
+
+  g_type_class_add_private (g_object_class, sizeof (HCPDebouncerPrivate));
+}
+
+HCPDebouncer *
+hcp_debouncer_new (guint quiet_min, guint quiet_max, guint max_latency)
+{
+  HCPDebouncer *debouncer = g_object_new (HCP_TYPE_DEBOUNCER, NULL);
+
+  debouncer->priv->quiet_min = quiet_min;
+  debouncer->priv->quiet_max = MAX (quiet_min, quiet_max);
+  debouncer->priv->max_latency = MAX (quiet_min, max_latency);
+  debouncer->priv->quiet = quiet_min;
+
+  return debouncer;
+}
+
+void
+hcp_debouncer_queue (HCPDebouncer *debouncer, const gchar *path)
+{
+  HCPDebouncerPrivate *priv;
+
+  g_return_if_fail (debouncer);
+  g_return_if_fail (HCP_IS_DEBOUNCER (debouncer));
+  g_return_if_fail (path);
+
+  priv = debouncer->priv;
+
+  priv->events_received++;
+  priv->batch_events++;
+
+  if (!g_hash_table_lookup (priv->paths, path))
+  {
+    gchar *key = g_strdup (path);
+    g_hash_table_insert (priv->paths, key, key);
+  }
+
+  if (priv->quiet_id)
+  {
+    /* Still bursting, be more patient next time */
+    g_source_remove (priv->quiet_id);
+    priv->quiet = MIN (priv->quiet * 2, priv->quiet_max);
+  }
+
+  priv->quiet_id = g_timeout_add (priv->quiet,
+                                  (GSourceFunc) hcp_debouncer_quiet_timeout,
+                                  debouncer);
+
+  if (!priv->latency_id)
+  {
+    priv->latency_id = g_timeout_add (priv->max_latency,
+                                      (GSourceFunc) hcp_debouncer_latency_timeout,
+                                      debouncer);
+  }
+}
+
+void
+hcp_debouncer_flush (HCPDebouncer *debouncer)
+{
+  HCPDebouncerPrivate *priv;
+  GHashTable *paths;
+
+  g_return_if_fail (debouncer);
+  g_return_if_fail (HCP_IS_DEBOUNCER (debouncer));
+
+  priv = debouncer->priv;
+
+  hcp_debouncer_remove_sources (debouncer);
+
+  if (g_hash_table_size (priv->paths) == 0)
+    return;
+
+  if (priv->batch_events <= 1)
+    priv->quiet = priv->quiet_min;
+  else
+    priv->quiet = MAX (priv->quiet / 2, priv->quiet_min);
+
+  priv->batch_events = 0;
+  priv->flushes++;
+
+  g_debug ("Flushing %u paths (%u events, %u flushes so far)",
+           g_hash_table_size (priv->paths),
+           priv->events_received,
+           priv->flushes);
+
+  /* Paths queued by the handlers go to the next batch */
+  paths = priv->paths;
+  priv->paths = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                       g_free, NULL);
+
+  g_object_ref (debouncer);
+
+  g_signal_emit (G_OBJECT (debouncer),
+                 signals[SIGNAL_FLUSH],
+                 0, paths);
+
+  g_object_unref (debouncer);
+
+  g_hash_table_destroy (paths);
+}
+
+void
+hcp_debouncer_cancel (HCPDebouncer *debouncer)
+{
+  g_return_if_fail (debouncer);
+  g_return_if_fail (HCP_IS_DEBOUNCER (debouncer));
+
+  hcp_debouncer_remove_sources (debouncer);
+
+  g_hash_table_remove_all (debouncer->priv->paths);
+  debouncer->priv->batch_events = 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * This file is part of hildon-control-panel
+ *
+ * Copyright (C) 2010 Nokia Corporation.
+ *
+ * Contact: Karoliina Salminen <karoliina.t.salminen@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef HCP_DEBOUNCER_H
+#define HCP_DEBOUNCER_H
+
+#include <glib.h>
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+typedef struct _HCPDebouncer HCPDebouncer;
+typedef struct _HCPDebouncerClass HCPDebouncerClass;
+typedef struct _HCPDebouncerPrivate HCPDebouncerPrivate;
+
+#define HCP_TYPE_DEBOUNCER            (hcp_debouncer_get_type ())
+#define HCP_DEBOUNCER(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), HCP_TYPE_DEBOUNCER, HCPDebouncer))
+#define HCP_DEBOUNCER_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass),  HCP_TYPE_DEBOUNCER, HCPDebouncerClass))
+#define HCP_IS_DEBOUNCER(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), HCP_TYPE_DEBOUNCER))
+#define HCP_IS_DEBOUNCER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass),  HCP_TYPE_DEBOUNCER))
+#define HCP_DEBOUNCER_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj),  HCP_TYPE_DEBOUNCER, HCPDebouncerClass))
+
+struct _HCPDebouncer
+{
+  GObject gobject;
+
+  HCPDebouncerPrivate *priv;
+};
+
+struct _HCPDebouncerClass
+{
+  GObjectClass parent_class;
+
+  /* paths is a set of the queued paths, only valid during emission */
+  void (*flush) (HCPDebouncer *debouncer, GHashTable *paths);
+};
+
+GType          hcp_debouncer_get_type    (void);
+
+HCPDebouncer*  hcp_debouncer_new         (guint         quiet_min,
+                                          guint         quiet_max,
+                                          guint         max_latency);
+
+void           hcp_debouncer_queue       (HCPDebouncer *debouncer,
+                                          const gchar  *path);
+
+void           hcp_debouncer_flush       (HCPDebouncer *debouncer);
+
+void           hcp_debouncer_cancel      (HCPDebouncer *debouncer);
+
+G_END_DECLS
+
+#endif
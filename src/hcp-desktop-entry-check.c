@@ -0,0 +1,423 @@
+/*
+ * This file is part of hildon-control-panel
+ *
+ * Copyright (C) 2010 Nokia Corporation.
+ *
+ * Contact: Karoliina Salminen <karoliina.t.salminen@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+
+/*
+ * Checks that the single pass .desktop parser reads the same entries
+ * as GKeyFile, and times both. The corpus is a set of built-in files
+ * (escapes, translations, repeated keys and groups...) plus the
+ * applet .desktop files found in the directories given on the
+ * command line, or in the installed applet directories by default.
+ *
+ * Usage: hcp-desktop-entry-check [DIR...]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "hcp-desktop-entry.h"
+
+#define HCP_CHECK_ROUNDS 2000
+
+/* Fixed, so that the translations picked do not depend on where the
+ * check runs; expands to fi_FI.UTF-8, fi_FI, fi, sv, C... */
+#define HCP_CHECK_LANGUAGES "fi_FI.UTF-8:sv"
+
+typedef struct {
+  const gchar *filename;
+  const gchar *contents;
+  gboolean     fast;     /* the single pass parser must take it */
+} HCPCheckFile;
+
+static const HCPCheckFile hcp_check_files[] = {
+  { "plain.desktop",
+    "[Desktop Entry]\n"
+    "Name=Display\n"
+    "X-control-panel-plugin=libcpdisplay.so\n",
+    TRUE },
+
+  { "full.desktop",
+    "# comment\n"
+    "\n"
+    "[Desktop Entry]\n"
+    "Encoding=UTF-8\n"
+    "Version=1.0\n"
+    "Type=HildonControlPanelPlugin\n"
+    "Name=cpa_ap_display\n"
+    "Comment=Not used\n"
+    "Icon=general_display\n"
+    "X-control-panel-plugin=libcpdisplay.so\n"
+    "Categories=Settings\n"
+    "X-Text-Domain=osso-applet-display\n"
+    "X-control-panel-requires=/component/product!=RX-51\n",
+    TRUE },
+
+  { "crlf.desktop",
+    "[Desktop Entry]\r\n"
+    "Name=Sound\r\n"
+    "X-control-panel-plugin=libcpsound.so\r\n"
+    "Icon=general_sound\r\n",
+    TRUE },
+
+  { "spaces.desktop",
+    "  [Desktop Entry]\n"
+    "Name = Spaced out\n"
+    "X-control-panel-plugin =   libcpspace.so\n"
+    "\tIcon=general_space\n",
+    TRUE },
+
+  { "escapes.desktop",
+    "[Desktop Entry]\n"
+    "Name=Tab\\there\\sand\\\\there\n"
+    "X-control-panel-plugin=/usr/lib/hcp/lib\\sspace.so\n"
+    "Icon=line\\nbreak\\rreturn\n",
+    TRUE },
+
+  { "locale.desktop",
+    "[Desktop Entry]\n"
+    "Name=Untranslated\n"
+    "Name[de]=Deutsch\n"
+    "Name[sv]=Svenska\n"
+    "Name[fi]=Suomi\n"
+    "Name[fi_FI]=Suomi (Suomi)\n"
+    "X-control-panel-plugin=libcplocale.so\n",
+    TRUE },
+
+  { "locale-fallback.desktop",
+    "[Desktop Entry]\n"
+    "Name[sv]=Svenska\n"
+    "Name=Untranslated\n"
+    "Name[de]=Deutsch\n"
+    "X-control-panel-plugin=libcpfallback.so\n",
+    TRUE },
+
+  { "locale-none.desktop",
+    "[Desktop Entry]\n"
+    "Name[de]=Deutsch\n"
+    "Name=Untranslated\n"
+    "Name[en_GB]=English\n"
+    "X-control-panel-plugin=libcpnone.so\n",
+    TRUE },
+
+  { "repeated.desktop",
+    "[Desktop Entry]\n"
+    "Name=First\n"
+    "Name[fi]=Ensimmainen\n"
+    "X-control-panel-plugin=libcpfirst.so\n"
+    "[Other Group]\n"
+    "Name=Elsewhere\n"
+    "X-control-panel-plugin=libcpother.so\n"
+    "[Desktop Entry]\n"
+    "Name=Second\n"
+    "Name[fi]=Toinen\n"
+    "Icon=general_second\n",
+    TRUE },
+
+  { "translated-plugin.desktop",
+    "[Desktop Entry]\n"
+    "Name=Plugin\n"
+    "X-control-panel-plugin=libcpplugin.so\n"
+    "X-control-panel-plugin[fi]=libcpsuomi.so\n"
+    "Icon[fi]=general_suomi\n",
+    TRUE },
+
+  /* Left to GKeyFile */
+  { "bad-escape.desktop",
+    "[Desktop Entry]\n"
+    "Name=Bad\\qescape\n"
+    "X-control-panel-plugin=libcpbad.so\n",
+    FALSE },
+
+  { "bad-optional-escape.desktop",
+    "[Desktop Entry]\n"
+    "Name=Good\n"
+    "X-control-panel-plugin=libcpgood.so\n"
+    "Icon=trailing\\\n",
+    FALSE },
+
+  { "no-plugin.desktop",
+    "[Desktop Entry]\n"
+    "Name=No plugin\n",
+    FALSE },
+
+  { "no-group.desktop",
+    "Name=Nowhere\n"
+    "X-control-panel-plugin=libcpnowhere.so\n",
+    FALSE },
+
+  { "wrong-group.desktop",
+    "[Desktop Action]\n"
+    "Name=Action\n"
+    "X-control-panel-plugin=libcpaction.so\n",
+    FALSE },
+
+  { "bad-line.desktop",
+    "[Desktop Entry]\n"
+    "Name=Bad line\n"
+    "X-control-panel-plugin=libcpline.so\n"
+    "no equals sign here\n",
+    FALSE },
+
+  { "empty.desktop",
+    "",
+    FALSE }
+};
+
+typedef struct {
+  gchar *filename;
+  gchar *contents;
+  gsize  length;
+  gint   fast;     /* -1 if the file may go either way */
+} HCPCheckCase;
+
+static gboolean
+hcp_check_entries_equal (HCPDesktopEntry *a, HCPDesktopEntry *b)
+{
+  return !g_strcmp0 (a->filename, b->filename) &&
+         hcp_file_stamp_equal (&a->stamp, &b->stamp) &&
+         !g_strcmp0 (a->name, b->name) &&
+         !g_strcmp0 (a->plugin, b->plugin) &&
+         !g_strcmp0 (a->icon, b->icon) &&
+         !g_strcmp0 (a->category, b->category) &&
+         !g_strcmp0 (a->text_domain, b->text_domain) &&
+         !g_strcmp0 (a->requires, b->requires) &&
+         a->pos == b->pos;
+}
+
+static void
+hcp_check_print_entry (const gchar *label, HCPDesktopEntry *entry)
+{
+  if (entry == NULL)
+  {
+    g_printerr ("  %s: (none)\n", label);
+    return;
+  }
+
+  g_printerr ("  %s: name=\"%s\" plugin=\"%s\" icon=\"%s\" category=\"%s\" "
+              "text-domain=\"%s\" requires=\"%s\"\n",
+              label,
+              entry->name ? entry->name : "(null)",
+              entry->plugin ? entry->plugin : "(null)",
+              entry->icon ? entry->icon : "(null)",
+              entry->category ? entry->category : "(null)",
+              entry->text_domain ? entry->text_domain : "(null)",
+              entry->requires ? entry->requires : "(null)");
+}
+
+/* Returns FALSE if the parsers disagree on the file */
+static gboolean
+hcp_check_case (HCPCheckCase *c)
+{
+  HCPDesktopEntry *fast, *keyfile;
+  gboolean ok = TRUE;
+
+  fast = hcp_desktop_entry_parse_contents (c->contents, c->length,
+                                           c->filename, NULL);
+  keyfile = hcp_desktop_entry_parse_keyfile (c->contents, c->length,
+                                             c->filename, NULL, NULL);
+
+  if (fast != NULL && !(keyfile != NULL &&
+                        hcp_check_entries_equal (fast, keyfile)))
+  {
+    g_printerr ("%s: the parsers disagree\n", c->filename);
+    ok = FALSE;
+  }
+  else if (c->fast == TRUE && fast == NULL)
+  {
+    g_printerr ("%s: left to GKeyFile\n", c->filename);
+    ok = FALSE;
+  }
+  else if (c->fast == FALSE && fast != NULL)
+  {
+    g_printerr ("%s: not left to GKeyFile\n", c->filename);
+    ok = FALSE;
+  }
+
+  if (!ok)
+  {
+    hcp_check_print_entry ("single pass", fast);
+    hcp_check_print_entry ("GKeyFile", keyfile);
+  }
+
+  if (fast)
+    hcp_desktop_entry_free (fast);
+
+  if (keyfile)
+    hcp_desktop_entry_free (keyfile);
+
+  return ok;
+}
+
+static void
+hcp_check_add_dir (GPtrArray *cases, const gchar *dir_path)
+{
+  GDir *dir;
+  const gchar *filename;
+
+  dir = g_dir_open (dir_path, 0, NULL);
+
+  if (dir == NULL)
+    return;
+
+  while ((filename = g_dir_read_name (dir)) != NULL)
+  {
+    HCPCheckCase *c;
+    gchar *path;
+
+    if (!g_str_has_suffix (filename, ".desktop"))
+      continue;
+
+    c = g_new0 (HCPCheckCase, 1);
+    path = g_build_filename (dir_path, filename, NULL);
+
+    if (!g_file_get_contents (path, &c->contents, &c->length, NULL))
+    {
+      g_free (c);
+      g_free (path);
+      continue;
+    }
+
+    c->filename = path;
+    c->fast = -1;
+
+    g_ptr_array_add (cases, c);
+  }
+
+  g_dir_close (dir);
+}
+
+/* Microseconds per file */
+static gdouble
+hcp_check_time (GPtrArray *cases, gboolean use_keyfile)
+{
+  GTimer *timer;
+  gdouble elapsed;
+  guint round, i;
+
+  timer = g_timer_new ();
+
+  for (round = 0; round < HCP_CHECK_ROUNDS; round++)
+  {
+    for (i = 0; i < cases->len; i++)
+    {
+      HCPCheckCase *c = g_ptr_array_index (cases, i);
+      HCPDesktopEntry *entry;
+
+      /* What hcp_desktop_entry_load () would do with the file */
+      entry = hcp_desktop_entry_parse_contents (c->contents, c->length,
+                                                c->filename, NULL);
+
+      if (entry == NULL || use_keyfile)
+      {
+        if (entry)
+          hcp_desktop_entry_free (entry);
+
+        entry = hcp_desktop_entry_parse_keyfile (c->contents, c->length,
+                                                 c->filename, NULL, NULL);
+      }
+
+      if (entry)
+        hcp_desktop_entry_free (entry);
+    }
+  }
+
+  elapsed = g_timer_elapsed (timer, NULL);
+  g_timer_destroy (timer);
+
+  return elapsed * 1e6 / (HCP_CHECK_ROUNDS * cases->len);
+}
+
+int
+main (int argc, char **argv)
+{
+  GPtrArray *cases;
+  gdouble fast_time, keyfile_time;
+  guint failed = 0;
+  guint i;
+
+  g_setenv ("LANGUAGE", HCP_CHECK_LANGUAGES, TRUE);
+
+  cases = g_ptr_array_new ();
+
+  for (i = 0; i < G_N_ELEMENTS (hcp_check_files); i++)
+  {
+    HCPCheckCase *c = g_new0 (HCPCheckCase, 1);
+
+    c->filename = g_strdup (hcp_check_files[i].filename);
+    c->contents = g_strdup (hcp_check_files[i].contents);
+    c->length = strlen (c->contents);
+    c->fast = hcp_check_files[i].fast;
+
+    g_ptr_array_add (cases, c);
+  }
+
+  if (argc > 1)
+  {
+    for (i = 1; i < (guint) argc; i++)
+      hcp_check_add_dir (cases, argv[i]);
+  }
+  else
+  {
+    hcp_check_add_dir (cases, CONTROLPANEL_ENTRY_DIR);
+    hcp_check_add_dir (cases, CONTROLPANEL_VENDOR_ENTRY_DIR);
+  }
+
+  for (i = 0; i < cases->len; i++)
+  {
+    if (!hcp_check_case (g_ptr_array_index (cases, i)))
+      failed++;
+  }
+
+  fast_time = hcp_check_time (cases, FALSE);
+  keyfile_time = hcp_check_time (cases, TRUE);
+
+  g_print ("%u files, %u built in\n",
+           cases->len, (guint) G_N_ELEMENTS (hcp_check_files));
+  g_print ("single pass: %.2f us per file (GKeyFile for the rest)\n",
+           fast_time);
+  g_print ("GKeyFile:    %.2f us per file\n", keyfile_time);
+
+  for (i = 0; i < cases->len; i++)
+  {
+    HCPCheckCase *c = g_ptr_array_index (cases, i);
+
+    g_free (c->filename);
+    g_free (c->contents);
+    g_free (c);
+  }
+
+  g_ptr_array_free (cases, TRUE);
+
+  if (failed)
+  {
+    g_printerr ("%u files failed\n", failed);
+    return 1;
+  }
+
+  return 0;
+}
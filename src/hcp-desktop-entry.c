@@ -0,0 +1,626 @@
+/*
+ * This file is part of hildon-control-panel
+ *
+ * Copyright (C) 2010 Nokia Corporation.
+ *
+ * Contact: Karoliina Salminen <karoliina.t.salminen@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "hcp-desktop-entry.h"
+#include "hcp-app-list.h"
+
+static gsize
+hcp_desktop_entry_string_size (const gchar *string)
+{
+  return string ? strlen (string) + 1 : 0;
+}
+
+static gchar *
+hcp_desktop_entry_pack_string (gchar **p, const gchar *string)
+{
+  gchar *result;
+  gsize size;
+
+  if (string == NULL)
+    return NULL;
+
+  size = strlen (string) + 1;
+
+  result = memcpy (*p, string, size);
+  *p += size;
+
+  return result;
+}
+
+/* The nanoseconds of st_mtime go by another name unless POSIX 2008
+ * is asked for, which -ansi does not */
+#if defined (__USE_XOPEN2K8)
+#define HCP_STAT_MTIME_NSEC(st) ((st)->st_mtim.tv_nsec)
+#elif defined (__GLIBC__)
+#define HCP_STAT_MTIME_NSEC(st) ((st)->st_mtimensec)
+#else
+#define HCP_STAT_MTIME_NSEC(st) 0
+#endif
+
+/* Fills stamp from path, following symlinks. Returns FALSE if path
+ * does not exist, stamp is then all zeroes. */
+gboolean
+hcp_file_stamp_get (const gchar *path, HCPFileStamp *stamp)
+{
+  struct stat st;
+
+  g_return_val_if_fail (path, FALSE);
+  g_return_val_if_fail (stamp, FALSE);
+
+  memset (stamp, 0, sizeof (HCPFileStamp));
+
+  if (g_stat (path, &st) != 0)
+    return FALSE;
+
+  stamp->mtime = (gint64) st.st_mtime;
+  stamp->mtime_nsec = (gint64) HCP_STAT_MTIME_NSEC (&st);
+  stamp->size = (gint64) st.st_size;
+  stamp->inode = (guint64) st.st_ino;
+
+  return TRUE;
+}
+
+gboolean
+hcp_file_stamp_equal (const HCPFileStamp *a, const HCPFileStamp *b)
+{
+  g_return_val_if_fail (a, FALSE);
+  g_return_val_if_fail (b, FALSE);
+
+  return a->mtime == b->mtime &&
+         a->mtime_nsec == b->mtime_nsec &&
+         a->size == b->size &&
+         a->inode == b->inode;
+}
+
+HCPDesktopEntry *
+hcp_desktop_entry_new (const gchar        *filename,
+                       const HCPFileStamp *stamp,
+                       const gchar        *name,
+                       const gchar        *plugin,
+                       const gchar        *icon,
+                       const gchar        *category,
+                       const gchar        *text_domain,
+                       const gchar        *requires)
+{
+  HCPDesktopEntry *entry;
+  gchar *p;
+
+  entry = g_malloc0 (sizeof (HCPDesktopEntry) +
+                     hcp_desktop_entry_string_size (filename));
+
+  p = (gchar *) (entry + 1);
+
+  entry->filename = hcp_desktop_entry_pack_string (&p, filename);
+
+  if (stamp)
+    entry->stamp = *stamp;
+
+  /* Borrowed by the HCPApp made from the entry, and by the entries
+   * read again for the same applet on later scans */
+  entry->name = g_intern_string (name);
+  entry->plugin = g_intern_string (plugin);
+  entry->icon = g_intern_string (icon);
+
+  /* Only a handful of distinct values, shared by many applets */
+  entry->category = g_intern_string (category);
+  entry->text_domain = g_intern_string (text_domain);
+  entry->requires = g_intern_string (requires);
+
+  return entry;
+}
+
+/* A value as found in the mapped file, still escaped */
+typedef struct {
+  const gchar *start;
+  gsize        length;
+} HCPDesktopValue;
+
+/* Language names with a lower index are preferred, untranslated
+ * values rank after all of them */
+static guint
+hcp_desktop_entry_rank_locale (const gchar         *locale,
+                               gsize                length,
+                               const gchar * const *languages)
+{
+  guint i;
+
+  if (locale == NULL)
+    return G_MAXUINT - 1;
+
+  for (i = 0; languages[i]; i++)
+  {
+    if (strlen (languages[i]) == length &&
+        !strncmp (languages[i], locale, length))
+      return i;
+  }
+
+  return G_MAXUINT;
+}
+
+/* Splits "Key[locale]" the way g_key_file_is_key_name() accepts it.
+ * Returns FALSE for anything GKeyFile would reject. */
+static gboolean
+hcp_desktop_entry_split_key (const gchar  *key,
+                             gsize         length,
+                             gsize        *name_length,
+                             const gchar **locale,
+                             gsize        *locale_length)
+{
+  const gchar *end = key + length;
+  const gchar *p = key;
+
+  while (p < end && *p != '[' && *p != ']')
+    p++;
+
+  if (p == key || p[-1] == ' ')
+    return FALSE;
+
+  *name_length = p - key;
+  *locale = NULL;
+  *locale_length = 0;
+
+  if (p == end)
+    return TRUE;
+
+  if (*p != '[')
+    return FALSE;
+
+  *locale = ++p;
+
+  while (p < end && (g_ascii_isalnum (*p) ||
+                     *p == '.' || *p == '_' || *p == '-' || *p == '@'))
+    p++;
+
+  if (p == *locale || p + 1 != end || *p != ']')
+    return FALSE;
+
+  *locale_length = p - *locale;
+
+  return TRUE;
+}
+
+/* Same escapes as g_key_file_get_string() */
+static gchar *
+hcp_desktop_entry_unescape (const HCPDesktopValue *value)
+{
+  const gchar *p = value->start;
+  const gchar *end = value->start + value->length;
+  gchar *result, *q;
+
+  q = result = g_malloc (value->length + 1);
+
+  while (p < end)
+  {
+    if (*p != '\\')
+    {
+      *q++ = *p++;
+      continue;
+    }
+
+    if (++p == end)
+      goto invalid;
+
+    switch (*p++)
+    {
+      case 's':
+        *q++ = ' ';
+        break;
+
+      case 'n':
+        *q++ = '\n';
+        break;
+
+      case 't':
+        *q++ = '\t';
+        break;
+
+      case 'r':
+        *q++ = '\r';
+        break;
+
+      case '\\':
+        *q++ = '\\';
+        break;
+
+      default:
+        goto invalid;
+    }
+  }
+
+  *q = '\0';
+
+  return result;
+
+invalid:
+  g_free (result);
+
+  return NULL;
+}
+
+static gboolean
+hcp_desktop_entry_take_value (const HCPDesktopValue *value, gchar **result)
+{
+  if (value->start == NULL)
+    return TRUE;
+
+  *result = hcp_desktop_entry_unescape (value);
+
+  return *result != NULL;
+}
+
+/*
+ * Single pass over the file contents, only looking at the keys of
+ * the [Desktop Entry] group the control panel uses. Values are kept
+ * as pointers into the buffer and only the winning ones are copied.
+ *
+ * Returns NULL whenever the result could differ from what GKeyFile
+ * makes of the file (syntax errors, bad escapes, missing keys...);
+ * the caller then takes the GKeyFile path, which also produces the
+ * right error.
+ */
+HCPDesktopEntry *
+hcp_desktop_entry_parse_contents (const gchar        *contents,
+                                  gsize               length,
+                                  const gchar        *filename,
+                                  const HCPFileStamp *stamp)
+{
+  HCPDesktopEntry *entry = NULL;
+  gchar *name_str = NULL, *plugin_str = NULL, *icon_str = NULL;
+  gchar *category_str = NULL, *text_domain_str = NULL, *requires_str = NULL;
+  const gchar * const *languages;
+  const gchar *p, *end;
+  HCPDesktopValue name, plugin, icon, category, text_domain, requires;
+  guint name_rank = G_MAXUINT;
+  gboolean had_group = FALSE;
+  gboolean in_group = FALSE;
+  gboolean found_group = FALSE;
+
+  if (length == 0 ||
+      memchr (contents, '\0', length) ||
+      !g_utf8_validate (contents, length, NULL))
+    return NULL;
+
+  memset (&name, 0, sizeof (HCPDesktopValue));
+  memset (&plugin, 0, sizeof (HCPDesktopValue));
+  memset (&icon, 0, sizeof (HCPDesktopValue));
+  memset (&category, 0, sizeof (HCPDesktopValue));
+  memset (&text_domain, 0, sizeof (HCPDesktopValue));
+  memset (&requires, 0, sizeof (HCPDesktopValue));
+
+  languages = g_get_language_names ();
+
+  p = contents;
+  end = contents + length;
+
+  while (p < end)
+  {
+    const gchar *line, *line_end, *eq, *key_end, *value;
+    const gchar *locale;
+    gsize name_length, locale_length;
+
+    line = p;
+    line_end = memchr (p, '\n', end - p);
+
+    if (line_end)
+      p = line_end + 1;
+    else
+      p = line_end = end;
+
+    if (line_end > line && line_end[-1] == '\r')
+      line_end--;
+
+    while (line < line_end && g_ascii_isspace (*line))
+      line++;
+
+    /* Blank lines and comments */
+    if (line == line_end || *line == '#')
+      continue;
+
+    if (*line == '[')
+    {
+      const gchar *group_end = memchr (line, ']', line_end - line);
+
+      if (!group_end)
+        return NULL;
+
+      for (key_end = group_end + 1; key_end < line_end; key_end++)
+      {
+        if (*key_end != ' ' && *key_end != '\t')
+          return NULL;
+      }
+
+      /* Repeated groups are merged, as GKeyFile does */
+      in_group = ((gsize) (group_end - line - 1) == strlen (HCP_DESKTOP_GROUP) &&
+                  !strncmp (line + 1, HCP_DESKTOP_GROUP, group_end - line - 1));
+
+      found_group |= in_group;
+      had_group = TRUE;
+
+      continue;
+    }
+
+    eq = memchr (line, '=', line_end - line);
+
+    if (!eq || eq == line || !had_group)
+      return NULL;
+
+    key_end = eq;
+
+    while (key_end > line && g_ascii_isspace (key_end[-1]))
+      key_end--;
+
+    if (!hcp_desktop_entry_split_key (line, key_end - line,
+                                      &name_length,
+                                      &locale, &locale_length))
+      return NULL;
+
+    if (!in_group)
+      continue;
+
+    value = eq + 1;
+
+    while (value < line_end && g_ascii_isspace (*value))
+      value++;
+
+#define HCP_KEY_IS(k) (name_length == strlen (k) && !strncmp (line, k, name_length))
+
+    if (HCP_KEY_IS (HCP_DESKTOP_KEY_NAME))
+    {
+      guint rank = hcp_desktop_entry_rank_locale (locale,
+                                                  locale_length,
+                                                  languages);
+
+      /* Later keys override earlier ones of the same rank */
+      if (rank != G_MAXUINT && rank <= name_rank)
+      {
+        name.start = value;
+        name.length = line_end - value;
+        name_rank = rank;
+      }
+    }
+    else if (locale == NULL)
+    {
+      HCPDesktopValue *target = NULL;
+
+      if (HCP_KEY_IS (HCP_DESKTOP_KEY_PLUGIN))
+        target = &plugin;
+      else if (HCP_KEY_IS (HCP_DESKTOP_KEY_ICON))
+        target = &icon;
+      else if (HCP_KEY_IS (HCP_DESKTOP_KEY_CATEGORY))
+        target = &category;
+      else if (HCP_KEY_IS (HCP_DESKTOP_KEY_TEXT_DOMAIN))
+        target = &text_domain;
+      else if (HCP_KEY_IS (HCP_DESKTOP_KEY_REQUIRES))
+        target = &requires;
+
+      if (target)
+      {
+        target->start = value;
+        target->length = line_end - value;
+      }
+    }
+
+#undef HCP_KEY_IS
+  }
+
+  if (!found_group || name.start == NULL || plugin.start == NULL)
+    return NULL;
+
+  if (hcp_desktop_entry_take_value (&name, &name_str) &&
+      hcp_desktop_entry_take_value (&plugin, &plugin_str) &&
+      hcp_desktop_entry_take_value (&icon, &icon_str) &&
+      hcp_desktop_entry_take_value (&category, &category_str) &&
+      hcp_desktop_entry_take_value (&text_domain, &text_domain_str) &&
+      hcp_desktop_entry_take_value (&requires, &requires_str))
+  {
+    entry = hcp_desktop_entry_new (filename, stamp,
+                                   name_str, plugin_str, icon_str,
+                                   category_str, text_domain_str,
+                                   requires_str);
+  }
+
+  g_free (name_str);
+  g_free (plugin_str);
+  g_free (icon_str);
+  g_free (category_str);
+  g_free (text_domain_str);
+  g_free (requires_str);
+
+  return entry;
+}
+
+/* The reference parser, for the files the one above turns down */
+HCPDesktopEntry *
+hcp_desktop_entry_parse_keyfile (const gchar        *contents,
+                                 gsize               length,
+                                 const gchar        *filename,
+                                 const HCPFileStamp *stamp,
+                                 GError            **error)
+{
+  HCPDesktopEntry *entry = NULL;
+  GKeyFile *keyfile;
+  GError *local_error = NULL;
+  gchar *name = NULL, *plugin = NULL, *icon = NULL;
+  gchar *category = NULL, *text_domain = NULL, *requires = NULL;
+
+  keyfile = g_key_file_new ();
+
+  g_key_file_load_from_data (keyfile,
+                             contents,
+                             length,
+                             G_KEY_FILE_NONE,
+                             &local_error);
+
+  if (local_error)
+    goto cleanup;
+
+  name = g_key_file_get_locale_string (keyfile,
+                                       HCP_DESKTOP_GROUP,
+                                       HCP_DESKTOP_KEY_NAME,
+                                       NULL /* current locale */,
+                                       &local_error);
+
+  if (local_error)
+    goto cleanup;
+
+  plugin = g_key_file_get_string (keyfile,
+                                  HCP_DESKTOP_GROUP,
+                                  HCP_DESKTOP_KEY_PLUGIN,
+                                  &local_error);
+
+  if (local_error)
+    goto cleanup;
+
+  /* The remaining keys are optional */
+  icon = g_key_file_get_string (keyfile,
+                                HCP_DESKTOP_GROUP,
+                                HCP_DESKTOP_KEY_ICON,
+                                NULL);
+
+  category = g_key_file_get_string (keyfile,
+                                    HCP_DESKTOP_GROUP,
+                                    HCP_DESKTOP_KEY_CATEGORY,
+                                    NULL);
+
+  text_domain = g_key_file_get_string (keyfile,
+                                       HCP_DESKTOP_GROUP,
+                                       HCP_DESKTOP_KEY_TEXT_DOMAIN,
+                                       NULL);
+
+  requires = g_key_file_get_string (keyfile,
+                                    HCP_DESKTOP_GROUP,
+                                    HCP_DESKTOP_KEY_REQUIRES,
+                                    NULL);
+
+  entry = hcp_desktop_entry_new (filename, stamp,
+                                 name, plugin, icon,
+                                 category, text_domain, requires);
+
+cleanup:
+  if (local_error)
+    g_propagate_error (error, local_error);
+
+  g_free (name);
+  g_free (plugin);
+  g_free (icon);
+  g_free (category);
+  g_free (text_domain);
+  g_free (requires);
+
+  g_key_file_free (keyfile);
+
+  return entry;
+}
+
+/* A GKeyFile must not be shared between threads, so entries parsed
+ * off the main thread get their position applied afterwards */
+HCPDesktopEntry *
+hcp_desktop_entry_load (const gchar        *dir_path,
+                        const gchar        *filename,
+                        const HCPFileStamp *stamp,
+                        GKeyFile           *pos_keyfile,
+                        GError            **error)
+{
+  HCPDesktopEntry *entry;
+  GMappedFile *mapped;
+  gchar *desktop_path;
+  GError *local_error = NULL;
+
+  g_return_val_if_fail (dir_path, NULL);
+  g_return_val_if_fail (filename, NULL);
+
+  desktop_path = g_build_filename (dir_path, filename, NULL);
+
+  mapped = g_mapped_file_new (desktop_path, FALSE, &local_error);
+
+  if (local_error)
+  {
+    g_propagate_error (error, local_error);
+    g_free (desktop_path);
+
+    return NULL;
+  }
+
+  entry = hcp_desktop_entry_parse_contents (g_mapped_file_get_contents (mapped),
+                                            g_mapped_file_get_length (mapped),
+                                            filename,
+                                            stamp);
+
+  if (!entry)
+  {
+    entry = hcp_desktop_entry_parse_keyfile (g_mapped_file_get_contents (mapped),
+                                             g_mapped_file_get_length (mapped),
+                                             filename,
+                                             stamp,
+                                             error);
+  }
+
+  g_mapped_file_unref (mapped);
+  g_free (desktop_path);
+
+  if (entry)
+    hcp_desktop_entry_set_pos (entry, pos_keyfile);
+
+  return entry;
+}
+
+void
+hcp_desktop_entry_set_pos (HCPDesktopEntry *entry, GKeyFile *pos_keyfile)
+{
+  gchar *group_title;
+
+  g_return_if_fail (entry);
+
+  /* try to read position from global .desktop file */
+  if (!pos_keyfile || !entry->category)
+    return;
+
+  group_title = g_ascii_strdown (entry->category, -1);
+
+  entry->pos = g_key_file_get_integer (pos_keyfile,
+                                       group_title,
+                                       entry->filename,
+                                       NULL);
+
+  g_free (group_title);
+}
+
+void
+hcp_desktop_entry_free (HCPDesktopEntry *entry)
+{
+  if (!entry)
+    return;
+
+  /* The strings live in the same block */
+  g_free (entry);
+}
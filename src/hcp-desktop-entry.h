@@ -0,0 +1,99 @@
+/*
+ * This file is part of hildon-control-panel
+ *
+ * Copyright (C) 2010 Nokia Corporation.
+ *
+ * Contact: Karoliina Salminen <karoliina.t.salminen@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef HCP_DESKTOP_ENTRY_H
+#define HCP_DESKTOP_ENTRY_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* One version of a file. st_mtime alone has a one second
+ * resolution, and a package upgrade can replace a file within the
+ * second it was last read; the size and the inode (for files
+ * renamed into place) catch most of those. */
+typedef struct _HCPFileStamp {
+  gint64   mtime;       /* seconds */
+  gint64   mtime_nsec;
+  gint64   size;
+  guint64  inode;
+} HCPFileStamp;
+
+gboolean         hcp_file_stamp_get          (const gchar        *path,
+                                              HCPFileStamp       *stamp);
+
+gboolean         hcp_file_stamp_equal        (const HCPFileStamp *a,
+                                              const HCPFileStamp *b);
+
+/* Plain record holding what the control panel needs from an
+ * applet .desktop file. The record and its filename are a single
+ * allocation; the other strings are interned, so that the HCPApp
+ * made from the entry can keep the same pointers. */
+typedef struct _HCPDesktopEntry {
+  gchar       *filename;    /* basename, e.g. "cpdisplay.desktop" */
+  HCPFileStamp stamp;       /* of the file when it was read */
+  const gchar *name;        /* interned */
+  const gchar *plugin;      /* interned */
+  const gchar *icon;        /* interned */
+  const gchar *category;    /* interned */
+  const gchar *text_domain; /* interned */
+  const gchar *requires;    /* interned, see hcp_sys_info_match () */
+  gint         pos;         /* 0 if not given in apporder/applets.desktop */
+} HCPDesktopEntry;
+
+HCPDesktopEntry* hcp_desktop_entry_new       (const gchar        *filename,
+                                              const HCPFileStamp *stamp,
+                                              const gchar        *name,
+                                              const gchar        *plugin,
+                                              const gchar        *icon,
+                                              const gchar        *category,
+                                              const gchar        *text_domain,
+                                              const gchar        *requires);
+
+HCPDesktopEntry* hcp_desktop_entry_load      (const gchar        *dir_path,
+                                              const gchar        *filename,
+                                              const HCPFileStamp *stamp,
+                                              GKeyFile           *pos_keyfile,
+                                              GError            **error);
+
+/* The two parsers behind hcp_desktop_entry_load (), also used by
+ * hcp-desktop-entry-check */
+HCPDesktopEntry* hcp_desktop_entry_parse_contents (const gchar        *contents,
+                                                   gsize               length,
+                                                   const gchar        *filename,
+                                                   const HCPFileStamp *stamp);
+
+HCPDesktopEntry* hcp_desktop_entry_parse_keyfile  (const gchar        *contents,
+                                                   gsize               length,
+                                                   const gchar        *filename,
+                                                   const HCPFileStamp *stamp,
+                                                   GError            **error);
+
+void             hcp_desktop_entry_set_pos   (HCPDesktopEntry *entry,
+                                              GKeyFile        *pos_keyfile);
+
+void             hcp_desktop_entry_free      (HCPDesktopEntry *entry);
+
+G_END_DECLS
+
+#endif
@@ -25,11 +25,12 @@
 #include <config.h>
 #endif
 
-#include <math.h>
+#include <string.h>
 
 #include <hildon/hildon-defines.h>
 
 #include <gtk/gtk.h>
+#include <gtk/gtk-a11y.h>
 
 #include "hcp-grid.h"
 #include "hcp-app.h"
@@ -39,94 +40,1520 @@
 #define HCP_GRID_GET_PRIVATE(object) \
   (G_TYPE_INSTANCE_GET_PRIVATE ((object), HCP_TYPE_GRID, HCPGridPrivate))
 
-G_DEFINE_TYPE (HCPGrid, hcp_grid, GTK_TYPE_ICON_VIEW)
+G_DEFINE_TYPE (HCPGrid, hcp_grid, GTK_TYPE_WIDGET)
 
 #define HCP_GRID_X_PADDING   4
 #define HCP_GRID_Y_PADDING   2
-#define HCP_ICON_SIZE        HILDON_ICON_PIXEL_SIZE_FINGER
+
+#define HCP_GRID_ITEM_WIDTH        300
+#define HCP_GRID_ICON_SPACING      6
+#define HCP_GRID_COLUMN_SPACING    HILDON_MARGIN_DOUBLE
+#define HCP_GRID_SECTION_SPACING   6
+#define HCP_GRID_HEADER_SPACING    10
+
+/* Header lines are themed as the separators that used to be put
+ * around the category names, see hcp-window.c */
+#define HCP_GRID_SEPARATOR_NAME    "hildon-control-panel-separator"
+
+typedef enum
+{
+  SIGNAL_ITEM_ACTIVATED,
+  N_SIGNALS
+} HCPGridSignals;
+
+static gint signals[N_SIGNALS];
+
+/* A section header, or up to n_columns items side by side */
+typedef struct
+{
+  gint     y;
+  gint     height;
+  gint     first_row;
+  gint     n_rows;
+  gboolean header;
+} HCPGridLine;
 
 struct _HCPGridPrivate {
-  GtkCellRenderer *text_cell;
-  GtkCellRenderer *pixbuf_cell;
-  gboolean         can_move_focus;
-  gboolean         focused_in;
-/*  gint             row_height;*/
-  gint             icon_size;
+  GtkTreeModel        *model;
+  GtkTreeRowReference *cursor;
+  gint                 pressed_row;
+  gint                 n_columns;
+  gint                 item_width;
+  gint                 icon_size;
+
+  /* Style of a horizontal GtkSeparator named HCP_GRID_SEPARATOR_NAME
+   * inside the grid, for the header lines */
+  GtkStyleContext     *separator_context;
+
+  /* The HCPGridAccessible of the grid, once asked for */
+  AtkObject           *accessible;
+
+  /* Worked out from the model when first needed after a change:
+   * HCPGridLine in top to bottom order, the index in lines of each
+   * row, and the resulting height. A change only drops the lines
+   * from the one of the changed row down, those above are kept.
+   * Items are only ever drawn, never backed by widgets or cell
+   * renderers. */
+  gboolean             layout_valid;
+  GArray              *lines;
+  GArray              *row_lines;
+  gint                 height;
 };
 
+static void hcp_grid_accessible_row_inserted  (HCPGrid *grid, gint row);
+static void hcp_grid_accessible_row_deleted   (HCPGrid *grid, gint row);
+static void hcp_grid_accessible_rows_reordered (HCPGrid *grid, gint *new_order);
+static void hcp_grid_accessible_row_changed   (HCPGrid *grid, gint row);
+static void hcp_grid_accessible_model_changed (HCPGrid *grid);
+static void hcp_grid_accessible_cursor_changed (HCPGrid *grid, gint old_row, gint row);
+static GType hcp_grid_accessible_get_type (void);
+
+static gboolean
+hcp_grid_row_is_header (GtkTreeModel *model, GtkTreeIter *iter)
+{
+  GObject *app = NULL;
+
+  gtk_tree_model_get (model, iter, HCP_STORE_APP, &app, -1);
+
+  if (app == NULL)
+    return TRUE;
+
+  g_object_unref (app);
+
+  return FALSE;
+}
+
+static gint
+hcp_grid_get_header_height (HCPGrid *grid)
+{
+  PangoLayout *layout;
+  gint height;
+
+  layout = gtk_widget_create_pango_layout (GTK_WIDGET (grid), NULL);
+  pango_layout_get_pixel_size (layout, NULL, &height);
+  g_object_unref (layout);
+
+  return height;
+}
+
+/* Lays out the rows past those still in row_lines */
+static void
+hcp_grid_validate_layout (HCPGrid *grid)
+{
+  HCPGridPrivate *priv = grid->priv;
+  GtkTreeIter iter;
+  gboolean valid;
+  gint header_height;
+  gint current = -1;
+  gint y = 0;
+  gint row;
+
+  if (priv->layout_valid)
+    return;
+
+  priv->layout_valid = TRUE;
+
+  if (priv->model == NULL)
+  {
+    g_array_set_size (priv->lines, 0);
+    g_array_set_size (priv->row_lines, 0);
+    priv->height = 0;
+
+    return;
+  }
+
+  row = priv->row_lines->len;
+
+  /* Carry on after the last line kept, filling it up if it is a
+   * line of items */
+  if (priv->lines->len > 0)
+  {
+    HCPGridLine *last = &g_array_index (priv->lines, HCPGridLine,
+                                        priv->lines->len - 1);
+
+    y = last->y + last->height;
+
+    if (last->header)
+      y += HCP_GRID_SECTION_SPACING;
+    else
+      current = priv->lines->len - 1;
+  }
+
+  header_height = hcp_grid_get_header_height (grid);
+
+  valid = gtk_tree_model_iter_nth_child (priv->model, &iter, NULL, row);
+
+  while (valid)
+  {
+    HCPGridLine line;
+    gint line_index;
+
+    if (hcp_grid_row_is_header (priv->model, &iter))
+    {
+      if (priv->lines->len > 0)
+        y += HCP_GRID_SECTION_SPACING;
+
+      line.y = y;
+      line.height = header_height;
+      line.first_row = row;
+      line.n_rows = 1;
+      line.header = TRUE;
+
+      g_array_append_val (priv->lines, line);
+      y += header_height + HCP_GRID_SECTION_SPACING;
+
+      /* The next item starts a new line */
+      current = -1;
+    }
+    else
+    {
+      if (current < 0 ||
+          g_array_index (priv->lines, HCPGridLine, current).n_rows >= priv->n_columns)
+      {
+        line.y = y;
+        line.height = HCP_GRID_ITEM_HEIGHT;
+        line.first_row = row;
+        line.n_rows = 0;
+        line.header = FALSE;
+
+        g_array_append_val (priv->lines, line);
+        y += HCP_GRID_ITEM_HEIGHT;
+
+        current = priv->lines->len - 1;
+      }
+
+      g_array_index (priv->lines, HCPGridLine, current).n_rows++;
+    }
+
+    line_index = priv->lines->len - 1;
+    g_array_append_val (priv->row_lines, line_index);
+
+    valid = gtk_tree_model_iter_next (priv->model, &iter);
+    row++;
+  }
+
+  priv->height = y;
+}
+
+/* Drops the layout of row and of the rows after it */
+static void
+hcp_grid_invalidate_layout_from (HCPGrid *grid, gint row)
+{
+  HCPGridPrivate *priv = grid->priv;
+
+  if (row < (gint) priv->row_lines->len)
+  {
+    gint index = g_array_index (priv->row_lines, gint, MAX (row, 0));
+
+    /* The line of row is laid out again from its start */
+    g_array_set_size (priv->row_lines,
+                      g_array_index (priv->lines, HCPGridLine, index).first_row);
+    g_array_set_size (priv->lines, index);
+  }
+
+  priv->layout_valid = FALSE;
+  priv->pressed_row = -1;
+
+  gtk_widget_queue_resize (GTK_WIDGET (grid));
+}
+
+static void
+hcp_grid_invalidate_layout (HCPGrid *grid)
+{
+  hcp_grid_invalidate_layout_from (grid, 0);
+}
+
+static HCPGridLine *
+hcp_grid_get_row_line (HCPGrid *grid, gint row)
+{
+  HCPGridPrivate *priv = grid->priv;
+
+  hcp_grid_validate_layout (grid);
+
+  if (row < 0 || row >= (gint) priv->row_lines->len)
+    return NULL;
+
+  return &g_array_index (priv->lines, HCPGridLine,
+                         g_array_index (priv->row_lines, gint, row));
+}
+
+static gboolean
+hcp_grid_get_row_area (HCPGrid *grid, gint row, GdkRectangle *area)
+{
+  HCPGridLine *line = hcp_grid_get_row_line (grid, row);
+
+  if (line == NULL)
+    return FALSE;
+
+  if (line->header)
+  {
+    GtkAllocation allocation;
+
+    gtk_widget_get_allocation (GTK_WIDGET (grid), &allocation);
+
+    area->x = 0;
+    area->width = allocation.width;
+  }
+  else
+  {
+    gint column = row - line->first_row;
+
+    area->x = column * (grid->priv->item_width + HCP_GRID_COLUMN_SPACING);
+    area->width = grid->priv->item_width;
+  }
+
+  area->y = line->y;
+  area->height = line->height;
+
+  return TRUE;
+}
+
+/* Index of the last line starting at or above y, -1 if none */
+static gint
+hcp_grid_find_line (HCPGrid *grid, gint y)
+{
+  GArray *lines = grid->priv->lines;
+  gint low = 0, high = (gint) lines->len - 1;
+  gint found = -1;
+
+  while (low <= high)
+  {
+    gint middle = (low + high) / 2;
+
+    if (g_array_index (lines, HCPGridLine, middle).y <= y)
+    {
+      found = middle;
+      low = middle + 1;
+    }
+    else
+    {
+      high = middle - 1;
+    }
+  }
+
+  return found;
+}
+
+/* Row of the item at x, y, -1 for headers and gaps */
+static gint
+hcp_grid_get_row_at_pos (HCPGrid *grid, gint x, gint y)
+{
+  HCPGridPrivate *priv = grid->priv;
+  HCPGridLine *line;
+  gint stride, column, index;
+
+  hcp_grid_validate_layout (grid);
+
+  index = hcp_grid_find_line (grid, y);
+
+  if (index < 0 || x < 0)
+    return -1;
+
+  line = &g_array_index (priv->lines, HCPGridLine, index);
+
+  if (line->header || y >= line->y + line->height)
+    return -1;
+
+  stride = priv->item_width + HCP_GRID_COLUMN_SPACING;
+  column = x / stride;
+
+  if (column >= line->n_rows || x - column * stride >= priv->item_width)
+    return -1;
+
+  return line->first_row + column;
+}
+
+static void
+hcp_grid_queue_draw_row (HCPGrid *grid, gint row)
+{
+  GdkRectangle area;
+
+  if (row >= 0 && row < (gint) grid->priv->row_lines->len &&
+      hcp_grid_get_row_area (grid, row, &area))
+    gtk_widget_queue_draw_area (GTK_WIDGET (grid),
+                                area.x, area.y,
+                                area.width, area.height);
+}
+
+static gint
+hcp_grid_get_cursor_row (HCPGrid *grid)
+{
+  GtkTreePath *path;
+  gint row = -1;
+
+  if (grid->priv->cursor == NULL)
+    return -1;
+
+  /* The reference follows the row through inserts and removals */
+  path = gtk_tree_row_reference_get_path (grid->priv->cursor);
+
+  if (path)
+  {
+    row = gtk_tree_path_get_indices (path)[0];
+    gtk_tree_path_free (path);
+  }
+
+  return row;
+}
+
+static void
+hcp_grid_set_cursor_row (HCPGrid *grid, gint row)
+{
+  HCPGridPrivate *priv = grid->priv;
+  gint old_row = hcp_grid_get_cursor_row (grid);
+
+  hcp_grid_queue_draw_row (grid, old_row);
+
+  if (priv->cursor)
+  {
+    gtk_tree_row_reference_free (priv->cursor);
+    priv->cursor = NULL;
+  }
+
+  if (row >= 0 && priv->model)
+  {
+    GtkTreePath *path = gtk_tree_path_new_from_indices (row, -1);
+
+    priv->cursor = gtk_tree_row_reference_new (priv->model, path);
+    gtk_tree_path_free (path);
+  }
+
+  hcp_grid_queue_draw_row (grid, row);
+
+  if (row != old_row)
+    hcp_grid_accessible_cursor_changed (grid, old_row, row);
+}
+
+static void
+hcp_grid_activate_row (HCPGrid *grid, gint row)
+{
+  GtkTreePath *path = gtk_tree_path_new_from_indices (row, -1);
+
+  g_signal_emit (G_OBJECT (grid), signals[SIGNAL_ITEM_ACTIVATED], 0, path);
+
+  gtk_tree_path_free (path);
+}
+
+/* Brings the item at row into the pannable area the grid is in */
+static void
+hcp_grid_scroll_to_row (HCPGrid *grid, gint row)
+{
+  GtkWidget *area;
+  GtkWidget *child;
+  GdkRectangle rect;
+  gint x, y;
+
+  if (!hcp_grid_get_row_area (grid, row, &rect))
+    return;
+
+  area = gtk_widget_get_ancestor (GTK_WIDGET (grid), HILDON_TYPE_PANNABLE_AREA);
+
+  if (area == NULL)
+    return;
+
+  /* Coordinates are those of what was added to the area */
+  child = gtk_bin_get_child (GTK_BIN (area));
+
+  if (GTK_IS_VIEWPORT (child))
+    child = gtk_bin_get_child (GTK_BIN (child));
+
+  if (gtk_widget_translate_coordinates (GTK_WIDGET (grid), child,
+                                        rect.x, rect.y + rect.height / 2,
+                                        &x, &y))
+    hildon_pannable_area_scroll_to (HILDON_PANNABLE_AREA (area), -1, y);
+}
+
+/* Next item from row in direction, skipping headers. From no row,
+ * the first item. */
+static gint
+hcp_grid_step (HCPGrid *grid, gint row, gint direction)
+{
+  gint n_rows = grid->priv->row_lines->len;
+
+  if (row < 0)
+  {
+    row = -1;
+    direction = 1;
+  }
+
+  for (row += direction; row >= 0 && row < n_rows; row += direction)
+  {
+    if (!hcp_grid_get_row_line (grid, row)->header)
+      return row;
+  }
+
+  return -1;
+}
+
+/* Item in the same column of the next line of items in direction,
+ * or the last one of a shorter line */
+static gint
+hcp_grid_step_line (HCPGrid *grid, gint row, gint direction)
+{
+  HCPGridPrivate *priv = grid->priv;
+  HCPGridLine *line;
+  gint index, column;
+
+  if (row < 0)
+    return hcp_grid_step (grid, -1, 1);
+
+  line = hcp_grid_get_row_line (grid, row);
+  column = row - line->first_row;
+
+  index = g_array_index (priv->row_lines, gint, row);
+
+  for (index += direction;
+       index >= 0 && index < (gint) priv->lines->len;
+       index += direction)
+  {
+    line = &g_array_index (priv->lines, HCPGridLine, index);
+
+    if (!line->header)
+      return line->first_row + MIN (column, line->n_rows - 1);
+  }
+
+  return -1;
+}
+
+static void
+hcp_grid_row_changed_cb (GtkTreeModel *model,
+                         GtkTreePath  *path,
+                         GtkTreeIter  *iter,
+                         HCPGrid      *grid)
+{
+  HCPGridPrivate *priv = grid->priv;
+  gint row = gtk_tree_path_get_indices (path)[0];
+  HCPGridLine *line = NULL;
+
+  if (row < (gint) priv->row_lines->len)
+    line = &g_array_index (priv->lines, HCPGridLine,
+                           g_array_index (priv->row_lines, gint, row));
+
+  /* Only turning a header into an item or back moves other rows,
+   * a new label or icon just needs the row drawn again */
+  if (line && line->header == hcp_grid_row_is_header (model, iter))
+    hcp_grid_queue_draw_row (grid, row);
+  else
+    hcp_grid_invalidate_layout_from (grid, row);
+
+  hcp_grid_accessible_row_changed (grid, row);
+}
+
+static void
+hcp_grid_row_inserted_cb (GtkTreeModel *model,
+                          GtkTreePath  *path,
+                          GtkTreeIter  *iter,
+                          HCPGrid      *grid)
+{
+  gint row = gtk_tree_path_get_indices (path)[0];
+
+  hcp_grid_invalidate_layout_from (grid, row);
+  hcp_grid_accessible_row_inserted (grid, row);
+}
+
+static void
+hcp_grid_row_deleted_cb (GtkTreeModel *model,
+                         GtkTreePath  *path,
+                         HCPGrid      *grid)
+{
+  gint row = gtk_tree_path_get_indices (path)[0];
+
+  hcp_grid_invalidate_layout_from (grid, row);
+  hcp_grid_accessible_row_deleted (grid, row);
+}
+
+static void
+hcp_grid_rows_reordered_cb (GtkTreeModel *model,
+                            GtkTreePath  *path,
+                            GtkTreeIter  *iter,
+                            gint         *new_order,
+                            HCPGrid      *grid)
+{
+  gint n_rows = gtk_tree_model_iter_n_children (model, NULL);
+  gint row = 0;
+
+  /* Rows before the first one moved keep their place */
+  while (row < n_rows && new_order[row] == row)
+    row++;
+
+  hcp_grid_invalidate_layout_from (grid, row);
+  hcp_grid_accessible_rows_reordered (grid, new_order);
+}
+
+static GtkStyleContext *
+hcp_grid_get_separator_context (HCPGrid *grid)
+{
+  HCPGridPrivate *priv = grid->priv;
+  GtkWidgetPath *path;
+
+  if (priv->separator_context)
+    return priv->separator_context;
+
+  path = gtk_widget_path_copy (gtk_widget_get_path (GTK_WIDGET (grid)));
+  gtk_widget_path_append_type (path, GTK_TYPE_SEPARATOR);
+  gtk_widget_path_iter_set_name (path, -1, HCP_GRID_SEPARATOR_NAME);
+
+  priv->separator_context = gtk_style_context_new ();
+  gtk_style_context_set_path (priv->separator_context, path);
+  gtk_style_context_set_parent (priv->separator_context,
+                                gtk_widget_get_style_context (GTK_WIDGET (grid)));
+  gtk_style_context_add_class (priv->separator_context,
+                               GTK_STYLE_CLASS_SEPARATOR);
+  gtk_style_context_add_class (priv->separator_context,
+                               GTK_STYLE_CLASS_HORIZONTAL);
+
+  gtk_widget_path_free (path);
+
+  return priv->separator_context;
+}
+
+static void
+hcp_grid_drop_separator_context (HCPGrid *grid)
+{
+  if (grid->priv->separator_context)
+  {
+    g_object_unref (grid->priv->separator_context);
+    grid->priv->separator_context = NULL;
+  }
+}
+
+static void
+hcp_grid_draw_header (HCPGrid         *grid,
+                      cairo_t         *cr,
+                      GtkStyleContext *context,
+                      GdkRectangle    *area,
+                      PangoLayout     *layout)
+{
+  GtkStyleContext *separator;
+  gint label_width, label_height;
+  gint label_x, middle;
+
+  pango_layout_set_width (layout, area->width * PANGO_SCALE);
+  pango_layout_get_pixel_size (layout, &label_width, &label_height);
+
+  label_x = area->x + (area->width - label_width) / 2;
+  middle = area->y + area->height / 2;
+
+  gtk_render_layout (context, cr,
+                     label_x, area->y + (area->height - label_height) / 2,
+                     layout);
+
+  separator = hcp_grid_get_separator_context (grid);
+
+  gtk_render_line (separator, cr,
+                   area->x, middle,
+                   label_x - HCP_GRID_HEADER_SPACING, middle);
+
+  gtk_render_line (separator, cr,
+                   label_x + label_width + HCP_GRID_HEADER_SPACING, middle,
+                   area->x + area->width, middle);
+}
+
+static void
+hcp_grid_draw_item (HCPGrid         *grid,
+                    cairo_t         *cr,
+                    GtkStyleContext *context,
+                    GdkRectangle    *area,
+                    PangoLayout     *layout,
+                    GdkPixbuf       *pixbuf,
+                    gboolean         selected)
+{
+  HCPGridPrivate *priv = grid->priv;
+  gint text_x, text_height;
+
+  if (selected)
+  {
+    gtk_style_context_set_state (context, GTK_STATE_FLAG_SELECTED);
+    gtk_render_background (context, cr,
+                           area->x, area->y,
+                           area->width, area->height);
+  }
+
+  if (pixbuf)
+    gtk_render_icon (context, cr, pixbuf,
+                     area->x + HCP_GRID_X_PADDING +
+                     (priv->icon_size - gdk_pixbuf_get_width (pixbuf)) / 2,
+                     area->y + (area->height - gdk_pixbuf_get_height (pixbuf)) / 2);
+
+  text_x = area->x + priv->icon_size + 2 * HCP_GRID_X_PADDING +
+           HCP_GRID_ICON_SPACING;
+
+  pango_layout_set_width (layout,
+                          MAX (area->x + area->width - text_x, 0) * PANGO_SCALE);
+  pango_layout_get_pixel_size (layout, NULL, &text_height);
+
+  gtk_render_layout (context, cr,
+                     text_x, area->y + (area->height - text_height) / 2,
+                     layout);
+
+  if (selected && gtk_widget_has_focus (GTK_WIDGET (grid)))
+    gtk_render_focus (context, cr,
+                      area->x, area->y,
+                      area->width, area->height);
+}
+
+static void
+hcp_grid_draw_row (HCPGrid         *grid,
+                   cairo_t         *cr,
+                   GtkStyleContext *context,
+                   gint             row,
+                   gboolean         selected)
+{
+  GtkTreeIter iter;
+  GdkRectangle area;
+  GdkPixbuf *pixbuf = NULL;
+  GObject *app = NULL;
+  gchar *label = NULL;
+  PangoLayout *layout;
+
+  if (!gtk_tree_model_iter_nth_child (grid->priv->model, &iter, NULL, row) ||
+      !hcp_grid_get_row_area (grid, row, &area))
+    return;
+
+  gtk_tree_model_get (grid->priv->model, &iter,
+                      HCP_STORE_ICON, &pixbuf,
+                      HCP_STORE_LABEL, &label,
+                      HCP_STORE_APP, &app,
+                      -1);
+
+  layout = gtk_widget_create_pango_layout (GTK_WIDGET (grid), label);
+  pango_layout_set_ellipsize (layout, PANGO_ELLIPSIZE_END);
+
+  gtk_style_context_save (context);
+
+  if (app == NULL)
+    hcp_grid_draw_header (grid, cr, context, &area, layout);
+  else
+    hcp_grid_draw_item (grid, cr, context, &area, layout, pixbuf, selected);
+
+  gtk_style_context_restore (context);
+
+  g_object_unref (layout);
+
+  if (pixbuf)
+    g_object_unref (pixbuf);
+
+  if (app)
+    g_object_unref (app);
+
+  g_free (label);
+}
+
+/* Only the lines crossing the area being redrawn are looked at, the
+ * rest of the model is not touched */
+static gboolean
+hcp_grid_draw (GtkWidget *widget, cairo_t *cr)
+{
+  HCPGrid *grid = HCP_GRID (widget);
+  HCPGridPrivate *priv = grid->priv;
+  GtkStyleContext *context;
+  GdkRectangle clip;
+  gint cursor;
+  gint i;
+
+  context = gtk_widget_get_style_context (widget);
+
+  gtk_render_background (context, cr, 0, 0,
+                         gtk_widget_get_allocated_width (widget),
+                         gtk_widget_get_allocated_height (widget));
+
+  if (priv->model == NULL)
+    return FALSE;
+
+  hcp_grid_validate_layout (grid);
+
+  if (!gdk_cairo_get_clip_rectangle (cr, &clip))
+  {
+    clip.x = 0;
+    clip.y = 0;
+    clip.width = gtk_widget_get_allocated_width (widget);
+    clip.height = priv->height;
+  }
+
+  cursor = hcp_grid_get_cursor_row (grid);
+
+  for (i = MAX (hcp_grid_find_line (grid, clip.y), 0);
+       i < (gint) priv->lines->len;
+       i++)
+  {
+    HCPGridLine *line = &g_array_index (priv->lines, HCPGridLine, i);
+    gint row;
+
+    if (line->y >= clip.y + clip.height)
+      break;
+
+    for (row = line->first_row; row < line->first_row + line->n_rows; row++)
+      hcp_grid_draw_row (grid, cr, context, row, row == cursor);
+  }
+
+  return FALSE;
+}
+
+static void
+hcp_grid_get_preferred_width (GtkWidget *widget,
+                              gint      *minimum,
+                              gint      *natural)
+{
+  HCPGridPrivate *priv = HCP_GRID (widget)->priv;
+
+  *minimum = *natural = priv->n_columns * priv->item_width +
+                        (priv->n_columns - 1) * HCP_GRID_COLUMN_SPACING;
+}
+
+static void
+hcp_grid_get_preferred_height (GtkWidget *widget,
+                               gint      *minimum,
+                               gint      *natural)
+{
+  HCPGrid *grid = HCP_GRID (widget);
+
+  hcp_grid_validate_layout (grid);
+
+  *minimum = *natural = grid->priv->height;
+}
+
+static void
+hcp_grid_realize (GtkWidget *widget)
+{
+  GtkAllocation allocation;
+  GdkWindowAttr attributes;
+  GdkWindow *window;
+
+  gtk_widget_set_realized (widget, TRUE);
+
+  gtk_widget_get_allocation (widget, &allocation);
+
+  memset (&attributes, 0, sizeof (attributes));
+  attributes.window_type = GDK_WINDOW_CHILD;
+  attributes.x = allocation.x;
+  attributes.y = allocation.y;
+  attributes.width = allocation.width;
+  attributes.height = allocation.height;
+  attributes.wclass = GDK_INPUT_OUTPUT;
+  attributes.visual = gtk_widget_get_visual (widget);
+  attributes.event_mask = gtk_widget_get_events (widget) |
+                          GDK_EXPOSURE_MASK |
+                          GDK_BUTTON_PRESS_MASK |
+                          GDK_BUTTON_RELEASE_MASK |
+                          GDK_KEY_PRESS_MASK;
+
+  window = gdk_window_new (gtk_widget_get_parent_window (widget),
+                           &attributes,
+                           GDK_WA_X | GDK_WA_Y | GDK_WA_VISUAL);
+
+  gtk_widget_set_window (widget, window);
+  gdk_window_set_user_data (window, widget);
+}
+
+static void
+hcp_grid_size_allocate (GtkWidget     *widget,
+                        GtkAllocation *allocation)
+{
+  gtk_widget_set_allocation (widget, allocation);
+
+  if (gtk_widget_get_realized (widget))
+    gdk_window_move_resize (gtk_widget_get_window (widget),
+                            allocation->x, allocation->y,
+                            allocation->width, allocation->height);
+}
+
+static gboolean
+hcp_grid_button_press (GtkWidget *widget, GdkEventButton *event)
+{
+  HCPGrid *grid = HCP_GRID (widget);
+
+  if (event->button != 1 || event->type != GDK_BUTTON_PRESS)
+    return FALSE;
+
+  grid->priv->pressed_row = hcp_grid_get_row_at_pos (grid, event->x, event->y);
+
+  if (grid->priv->pressed_row >= 0)
+  {
+    if (!gtk_widget_has_focus (widget))
+      gtk_widget_grab_focus (widget);
+
+    hcp_grid_set_cursor_row (grid, grid->priv->pressed_row);
+  }
+
+  return TRUE;
+}
+
+static gboolean
+hcp_grid_button_release (GtkWidget *widget, GdkEventButton *event)
+{
+  HCPGrid *grid = HCP_GRID (widget);
+  gint row;
+
+  if (event->button != 1)
+    return FALSE;
+
+  row = hcp_grid_get_row_at_pos (grid, event->x, event->y);
+
+  /* Activates on tap, like GtkIconView in Hildon mode */
+  if (row >= 0 && row == grid->priv->pressed_row)
+    hcp_grid_activate_row (grid, row);
+
+  grid->priv->pressed_row = -1;
+
+  return TRUE;
+}
+
+static gboolean
+hcp_grid_key_press (GtkWidget *widget, GdkEventKey *event)
+{
+  HCPGrid *grid = HCP_GRID (widget);
+  gint row, target;
+
+  hcp_grid_validate_layout (grid);
+
+  row = hcp_grid_get_cursor_row (grid);
+
+  switch (event->keyval)
+  {
+    case GDK_KEY_Return:
+    case GDK_KEY_KP_Enter:
+    case GDK_KEY_ISO_Enter:
+    case GDK_KEY_space:
+    case GDK_KEY_KP_Space:
+      if (row < 0)
+        return FALSE;
+
+      hcp_grid_activate_row (grid, row);
+      return TRUE;
+
+    case GDK_KEY_Left:
+    case GDK_KEY_KP_Left:
+      target = hcp_grid_step (grid, row, -1);
+      break;
+
+    case GDK_KEY_Right:
+    case GDK_KEY_KP_Right:
+      target = hcp_grid_step (grid, row, 1);
+      break;
+
+    case GDK_KEY_Up:
+    case GDK_KEY_KP_Up:
+      target = hcp_grid_step_line (grid, row, -1);
+      break;
+
+    case GDK_KEY_Down:
+    case GDK_KEY_KP_Down:
+      target = hcp_grid_step_line (grid, row, 1);
+      break;
+
+    default:
+      return GTK_WIDGET_CLASS (hcp_grid_parent_class)->key_press_event (widget, event);
+  }
+
+  /* Past the first or last item, focus may move on */
+  if (target < 0)
+    return FALSE;
+
+  hcp_grid_set_cursor_row (grid, target);
+  hcp_grid_scroll_to_row (grid, target);
+
+  return TRUE;
+}
+
+static gboolean
+hcp_grid_focus_changed (GtkWidget *widget, GdkEventFocus *event)
+{
+  HCPGrid *grid = HCP_GRID (widget);
+
+  hcp_grid_queue_draw_row (grid, hcp_grid_get_cursor_row (grid));
+
+  return FALSE;
+}
+
+/* Accessibility. As GtkIconView did, the grid is a layered pane with
+ * a child per row: a label for headers, an icon for items, which
+ * can be selected and activated. The children are made when first
+ * asked for and follow their row through model changes. */
+
+typedef struct
+{
+  AtkObject  parent;
+
+  /* NULL once the row or the grid is gone */
+  HCPGrid   *grid;
+  gint       row;
+  gboolean   header;
+  gchar     *name;
+} HCPGridItemAccessible;
+
+typedef struct
+{
+  AtkObjectClass parent_class;
+} HCPGridItemAccessibleClass;
+
+typedef struct
+{
+  GtkWidgetAccessible parent;
+
+  /* HCPGridItemAccessible of each row, NULL for rows not asked for */
+  GPtrArray *items;
+} HCPGridAccessible;
+
+typedef struct
+{
+  GtkWidgetAccessibleClass parent_class;
+} HCPGridAccessibleClass;
+
+static GType hcp_grid_item_accessible_get_type (void);
+static void hcp_grid_item_accessible_action_init (AtkActionIface *iface);
+static void hcp_grid_item_accessible_component_init (AtkComponentIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (HCPGridItemAccessible, hcp_grid_item_accessible, ATK_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (ATK_TYPE_ACTION,
+                                                hcp_grid_item_accessible_action_init)
+                         G_IMPLEMENT_INTERFACE (ATK_TYPE_COMPONENT,
+                                                hcp_grid_item_accessible_component_init))
+
+G_DEFINE_TYPE (HCPGridAccessible, hcp_grid_accessible, GTK_TYPE_WIDGET_ACCESSIBLE)
+
+#define HCP_GRID_ITEM_ACCESSIBLE(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), hcp_grid_item_accessible_get_type (), HCPGridItemAccessible))
+#define HCP_GRID_ACCESSIBLE(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), hcp_grid_accessible_get_type (), HCPGridAccessible))
+
+static const gchar *
+hcp_grid_item_accessible_get_name (AtkObject *object)
+{
+  HCPGridItemAccessible *item = HCP_GRID_ITEM_ACCESSIBLE (object);
+  GtkTreeModel *model;
+  GtkTreeIter iter;
+
+  if (object->name)
+    return object->name;
+
+  g_free (item->name);
+  item->name = NULL;
+
+  if (item->grid == NULL)
+    return NULL;
+
+  model = item->grid->priv->model;
+
+  /* Read each time, the label follows the locale and the list */
+  if (model && gtk_tree_model_iter_nth_child (model, &iter, NULL, item->row))
+    gtk_tree_model_get (model, &iter, HCP_STORE_LABEL, &item->name, -1);
+
+  return item->name;
+}
+
+static gint
+hcp_grid_item_accessible_get_index_in_parent (AtkObject *object)
+{
+  HCPGridItemAccessible *item = HCP_GRID_ITEM_ACCESSIBLE (object);
+
+  return item->grid ? item->row : -1;
+}
+
+static AtkStateSet *
+hcp_grid_item_accessible_ref_state_set (AtkObject *object)
+{
+  HCPGridItemAccessible *item = HCP_GRID_ITEM_ACCESSIBLE (object);
+  AtkStateSet *states = atk_state_set_new ();
+  GtkWidget *widget;
+
+  if (item->grid == NULL)
+  {
+    atk_state_set_add_state (states, ATK_STATE_DEFUNCT);
+    return states;
+  }
+
+  widget = GTK_WIDGET (item->grid);
+
+  atk_state_set_add_state (states, ATK_STATE_ENABLED);
+  atk_state_set_add_state (states, ATK_STATE_SENSITIVE);
+  atk_state_set_add_state (states, ATK_STATE_VISIBLE);
+
+  if (gtk_widget_get_mapped (widget))
+    atk_state_set_add_state (states, ATK_STATE_SHOWING);
+
+  if (item->header)
+    return states;
+
+  atk_state_set_add_state (states, ATK_STATE_SELECTABLE);
+  atk_state_set_add_state (states, ATK_STATE_FOCUSABLE);
+
+  if (item->row == hcp_grid_get_cursor_row (item->grid))
+  {
+    atk_state_set_add_state (states, ATK_STATE_SELECTED);
+
+    if (gtk_widget_has_focus (widget))
+      atk_state_set_add_state (states, ATK_STATE_FOCUSED);
+  }
+
+  return states;
+}
+
+static void
+hcp_grid_item_accessible_finalize (GObject *object)
+{
+  g_free (HCP_GRID_ITEM_ACCESSIBLE (object)->name);
+
+  G_OBJECT_CLASS (hcp_grid_item_accessible_parent_class)->finalize (object);
+}
+
+static void
+hcp_grid_item_accessible_class_init (HCPGridItemAccessibleClass *klass)
+{
+  GObjectClass *g_object_class = (GObjectClass *) klass;
+  AtkObjectClass *atk_class = (AtkObjectClass *) klass;
+
+  g_object_class->finalize = hcp_grid_item_accessible_finalize;
+
+  atk_class->get_name = hcp_grid_item_accessible_get_name;
+  atk_class->get_index_in_parent = hcp_grid_item_accessible_get_index_in_parent;
+  atk_class->ref_state_set = hcp_grid_item_accessible_ref_state_set;
+}
+
+static void
+hcp_grid_item_accessible_init (HCPGridItemAccessible *item)
+{
+  item->grid = NULL;
+  item->row = -1;
+  item->header = FALSE;
+  item->name = NULL;
+}
+
+static gint
+hcp_grid_item_accessible_get_n_actions (AtkAction *action)
+{
+  HCPGridItemAccessible *item = HCP_GRID_ITEM_ACCESSIBLE (action);
+
+  return item->header ? 0 : 1;
+}
+
 static gboolean
-hcp_grid_update_icon (GtkTreeModel *model,
-                      GtkTreePath  *path,
-                      GtkTreeIter  *iter,
-                      gpointer      user_data)
+hcp_grid_item_accessible_do_action (AtkAction *action, gint i)
 {
-  HCPApp *app;
-  GtkIconTheme *icon_theme;
-  GdkPixbuf *icon_pixbuf;
-  gchar *icon = NULL;
-  GError *error = NULL;
+  HCPGridItemAccessible *item = HCP_GRID_ITEM_ACCESSIBLE (action);
 
-  g_return_val_if_fail (user_data, TRUE);
-  g_return_val_if_fail (HCP_IS_GRID (user_data), TRUE);
+  if (i != 0 || item->header || item->grid == NULL)
+    return FALSE;
 
-/*  priv = HCP_GRID (user_data)->priv; */
+  hcp_grid_activate_row (item->grid, item->row);
 
-  gtk_tree_model_get (GTK_TREE_MODEL (model), iter, 
-                      HCP_STORE_APP, &app,
-                      -1);
+  return TRUE;
+}
+
+static const gchar *
+hcp_grid_item_accessible_get_action_name (AtkAction *action, gint i)
+{
+  HCPGridItemAccessible *item = HCP_GRID_ITEM_ACCESSIBLE (action);
+
+  if (i != 0 || item->header)
+    return NULL;
+
+  return "activate";
+}
+
+static void
+hcp_grid_item_accessible_action_init (AtkActionIface *iface)
+{
+  iface->get_n_actions = hcp_grid_item_accessible_get_n_actions;
+  iface->do_action = hcp_grid_item_accessible_do_action;
+  iface->get_name = hcp_grid_item_accessible_get_action_name;
+}
 
-  g_object_get (G_OBJECT (app),
-                "icon", &icon,
-                NULL);
+static void
+hcp_grid_item_accessible_get_extents (AtkComponent *component,
+                                      gint         *x,
+                                      gint         *y,
+                                      gint         *width,
+                                      gint         *height,
+                                      AtkCoordType  coord_type)
+{
+  HCPGridItemAccessible *item = HCP_GRID_ITEM_ACCESSIBLE (component);
+  GdkWindow *window;
+  GdkRectangle area;
+  gint origin_x, origin_y;
+
+  *x = *y = G_MININT;
+  *width = *height = 0;
+
+  if (item->grid == NULL ||
+      !gtk_widget_get_realized (GTK_WIDGET (item->grid)) ||
+      !hcp_grid_get_row_area (item->grid, item->row, &area))
+    return;
 
-  icon_theme = gtk_icon_theme_get_default ();
+  window = gtk_widget_get_window (GTK_WIDGET (item->grid));
+  gdk_window_get_origin (window, &origin_x, &origin_y);
 
-  icon_pixbuf = gtk_icon_theme_load_icon (icon_theme,
-                                          icon,
-                                         /* priv->icon_size, */
-					  HCP_ICON_SIZE,
-                                          0, 
-                                          &error);
+  *x = origin_x + area.x;
+  *y = origin_y + area.y;
+  *width = area.width;
+  *height = area.height;
 
-  if (icon_pixbuf == NULL) 
+  if (coord_type == ATK_XY_WINDOW)
   {
-    if (error)
-    {
-      g_warning ("Couldn't load icon \"%s\": %s", icon, error->message);
-      g_error_free (error);
-    }
+    gdk_window_get_origin (gdk_window_get_toplevel (window),
+                           &origin_x, &origin_y);
+
+    *x -= origin_x;
+    *y -= origin_y;
+  }
+}
 
-    error = NULL;
+static gboolean
+hcp_grid_item_accessible_grab_focus (AtkComponent *component)
+{
+  HCPGridItemAccessible *item = HCP_GRID_ITEM_ACCESSIBLE (component);
 
-    icon_pixbuf = gtk_icon_theme_load_icon (icon_theme,
-                                            HCP_DEFAULT_ICON_BASENAME,
-                                        /*    priv->icon_size, */
-     					    HCP_ICON_SIZE,
-                                            0, 
-                                            &error);
+  if (item->header || item->grid == NULL)
+    return FALSE;
 
-    if (icon_pixbuf == NULL) 
-    {
-      g_warning ("Couldn't load default icon: %s", error->message);
-      g_error_free (error);
-    }
+  gtk_widget_grab_focus (GTK_WIDGET (item->grid));
+  hcp_grid_set_cursor_row (item->grid, item->row);
+  hcp_grid_scroll_to_row (item->grid, item->row);
+
+  return TRUE;
+}
+
+static void
+hcp_grid_item_accessible_component_init (AtkComponentIface *iface)
+{
+  iface->get_extents = hcp_grid_item_accessible_get_extents;
+  iface->grab_focus = hcp_grid_item_accessible_grab_focus;
+}
+
+static void
+hcp_grid_accessible_initialize (AtkObject *object, gpointer data)
+{
+  ATK_OBJECT_CLASS (hcp_grid_accessible_parent_class)->initialize (object, data);
+
+  object->role = ATK_ROLE_LAYERED_PANE;
+
+  HCP_GRID (data)->priv->accessible = object;
+}
+
+static gint
+hcp_grid_accessible_get_n_children (AtkObject *object)
+{
+  GtkWidget *widget = gtk_accessible_get_widget (GTK_ACCESSIBLE (object));
+  GtkTreeModel *model;
+
+  if (widget == NULL)
+    return 0;
+
+  model = HCP_GRID (widget)->priv->model;
+
+  return model ? gtk_tree_model_iter_n_children (model, NULL) : 0;
+}
+
+static AtkObject *
+hcp_grid_accessible_ref_child (AtkObject *object, gint i)
+{
+  HCPGridAccessible *accessible = HCP_GRID_ACCESSIBLE (object);
+  GtkWidget *widget = gtk_accessible_get_widget (GTK_ACCESSIBLE (object));
+  HCPGridItemAccessible *item;
+  GtkTreeModel *model;
+  GtkTreeIter iter;
+
+  if (widget == NULL || (model = HCP_GRID (widget)->priv->model) == NULL ||
+      !gtk_tree_model_iter_nth_child (model, &iter, NULL, i))
+    return NULL;
+
+  if (i >= (gint) accessible->items->len)
+    g_ptr_array_set_size (accessible->items, i + 1);
+
+  item = g_ptr_array_index (accessible->items, i);
+
+  if (item == NULL)
+  {
+    item = g_object_new (hcp_grid_item_accessible_get_type (), NULL);
+
+    item->grid = HCP_GRID (widget);
+    item->row = i;
+    item->header = hcp_grid_row_is_header (model, &iter);
+
+    atk_object_set_role (ATK_OBJECT (item),
+                         item->header ? ATK_ROLE_LABEL : ATK_ROLE_ICON);
+    atk_object_set_parent (ATK_OBJECT (item), object);
+
+    g_ptr_array_index (accessible->items, i) = item;
   }
 
-  gtk_list_store_set (GTK_LIST_STORE (model), iter, 
-                      HCP_STORE_ICON, icon_pixbuf, 
-                      -1);
+  return g_object_ref (item);
+}
+
+/* Marks the children from first on as gone and forgets them */
+static void
+hcp_grid_accessible_drop_items (HCPGridAccessible *accessible, guint first)
+{
+  guint i;
 
-  g_free (icon);
+  for (i = first; i < accessible->items->len; i++)
+  {
+    HCPGridItemAccessible *item = g_ptr_array_index (accessible->items, i);
 
-  return FALSE;
+    if (item == NULL)
+      continue;
+
+    item->grid = NULL;
+    atk_object_notify_state_change (ATK_OBJECT (item), ATK_STATE_DEFUNCT, TRUE);
+    g_object_unref (item);
+  }
+
+  if (first < accessible->items->len)
+    g_ptr_array_set_size (accessible->items, first);
+}
+
+static void
+hcp_grid_accessible_finalize (GObject *object)
+{
+  HCPGridAccessible *accessible = HCP_GRID_ACCESSIBLE (object);
+
+  hcp_grid_accessible_drop_items (accessible, 0);
+  g_ptr_array_free (accessible->items, TRUE);
+
+  G_OBJECT_CLASS (hcp_grid_accessible_parent_class)->finalize (object);
+}
+
+static void
+hcp_grid_accessible_class_init (HCPGridAccessibleClass *klass)
+{
+  GObjectClass *g_object_class = (GObjectClass *) klass;
+  AtkObjectClass *atk_class = (AtkObjectClass *) klass;
+
+  g_object_class->finalize = hcp_grid_accessible_finalize;
+
+  atk_class->initialize = hcp_grid_accessible_initialize;
+  atk_class->get_n_children = hcp_grid_accessible_get_n_children;
+  atk_class->ref_child = hcp_grid_accessible_ref_child;
+}
+
+static void
+hcp_grid_accessible_init (HCPGridAccessible *accessible)
+{
+  accessible->items = g_ptr_array_new ();
+}
+
+/* Gives the children from first on the row they are now at */
+static void
+hcp_grid_accessible_renumber (HCPGridAccessible *accessible, guint first)
+{
+  guint i;
+
+  for (i = first; i < accessible->items->len; i++)
+  {
+    HCPGridItemAccessible *item = g_ptr_array_index (accessible->items, i);
+
+    if (item)
+      item->row = i;
+  }
+}
+
+static void
+hcp_grid_accessible_row_inserted (HCPGrid *grid, gint row)
+{
+  HCPGridAccessible *accessible;
+
+  if (grid->priv->accessible == NULL)
+    return;
+
+  accessible = HCP_GRID_ACCESSIBLE (grid->priv->accessible);
+
+  if (row < (gint) accessible->items->len)
+  {
+    GPtrArray *items = accessible->items;
+
+    g_ptr_array_add (items, NULL);
+    memmove (&items->pdata[row + 1], &items->pdata[row],
+             (items->len - row - 1) * sizeof (gpointer));
+    items->pdata[row] = NULL;
+
+    hcp_grid_accessible_renumber (accessible, row + 1);
+  }
+
+  g_signal_emit_by_name (accessible, "children-changed::add", row, NULL);
+}
+
+static void
+hcp_grid_accessible_row_deleted (HCPGrid *grid, gint row)
+{
+  HCPGridAccessible *accessible;
+  HCPGridItemAccessible *item = NULL;
+
+  if (grid->priv->accessible == NULL)
+    return;
+
+  accessible = HCP_GRID_ACCESSIBLE (grid->priv->accessible);
+
+  if (row < (gint) accessible->items->len)
+  {
+    item = g_ptr_array_remove_index (accessible->items, row);
+    hcp_grid_accessible_renumber (accessible, row);
+  }
+
+  g_signal_emit_by_name (accessible, "children-changed::remove", row, item);
+
+  if (item)
+  {
+    item->grid = NULL;
+    atk_object_notify_state_change (ATK_OBJECT (item), ATK_STATE_DEFUNCT, TRUE);
+    g_object_unref (item);
+  }
+}
+
+static void
+hcp_grid_accessible_rows_reordered (HCPGrid *grid, gint *new_order)
+{
+  HCPGridAccessible *accessible;
+  GPtrArray *items;
+  gint n_rows, i;
+
+  if (grid->priv->accessible == NULL)
+    return;
+
+  accessible = HCP_GRID_ACCESSIBLE (grid->priv->accessible);
+  n_rows = gtk_tree_model_iter_n_children (grid->priv->model, NULL);
+
+  if (accessible->items->len > 0)
+  {
+    g_ptr_array_set_size (accessible->items, n_rows);
+    items = g_ptr_array_sized_new (n_rows);
+
+    /* new_order[new row] = old row */
+    for (i = 0; i < n_rows; i++)
+      g_ptr_array_add (items, g_ptr_array_index (accessible->items, new_order[i]));
+
+    g_ptr_array_free (accessible->items, TRUE);
+    accessible->items = items;
+
+    hcp_grid_accessible_renumber (accessible, 0);
+  }
+
+  g_signal_emit_by_name (accessible, "visible-data-changed");
+}
+
+static void
+hcp_grid_accessible_row_changed (HCPGrid *grid, gint row)
+{
+  HCPGridAccessible *accessible;
+
+  if (grid->priv->accessible == NULL)
+    return;
+
+  accessible = HCP_GRID_ACCESSIBLE (grid->priv->accessible);
+
+  if (row < (gint) accessible->items->len &&
+      g_ptr_array_index (accessible->items, row))
+    g_object_notify (G_OBJECT (g_ptr_array_index (accessible->items, row)),
+                     "accessible-name");
+}
+
+/* The children of the previous model are gone */
+static void
+hcp_grid_accessible_model_changed (HCPGrid *grid)
+{
+  if (grid->priv->accessible == NULL)
+    return;
+
+  hcp_grid_accessible_drop_items (HCP_GRID_ACCESSIBLE (grid->priv->accessible), 0);
+
+  g_signal_emit_by_name (grid->priv->accessible, "visible-data-changed");
+}
+
+static void
+hcp_grid_accessible_cursor_changed (HCPGrid *grid, gint old_row, gint row)
+{
+  HCPGridAccessible *accessible;
+  AtkObject *item;
+
+  if (grid->priv->accessible == NULL)
+    return;
+
+  accessible = HCP_GRID_ACCESSIBLE (grid->priv->accessible);
+
+  if (old_row >= 0 && old_row < (gint) accessible->items->len &&
+      (item = g_ptr_array_index (accessible->items, old_row)) != NULL)
+    atk_object_notify_state_change (item, ATK_STATE_SELECTED, FALSE);
+
+  if (row < 0)
+    return;
+
+  item = atk_object_ref_accessible_child (grid->priv->accessible, row);
+
+  if (item == NULL)
+    return;
+
+  atk_object_notify_state_change (item, ATK_STATE_SELECTED, TRUE);
+
+  if (gtk_widget_has_focus (GTK_WIDGET (grid)))
+    g_signal_emit_by_name (grid->priv->accessible, "active-descendant-changed", item);
+
+  g_object_unref (item);
+}
+
+static void
+hcp_grid_style_updated (GtkWidget *widget)
+{
+  GTK_WIDGET_CLASS (hcp_grid_parent_class)->style_updated (widget);
+
+  /* The separators are looked up again under the new style, and
+   * the header height follows the font */
+  hcp_grid_drop_separator_context (HCP_GRID (widget));
+  hcp_grid_invalidate_layout (HCP_GRID (widget));
+}
+
+static void
+hcp_grid_dispose (GObject *object)
+{
+  hcp_grid_set_model (HCP_GRID (object), NULL);
+  hcp_grid_drop_separator_context (HCP_GRID (object));
+
+  G_OBJECT_CLASS (hcp_grid_parent_class)->dispose (object);
+}
+
+static void
+hcp_grid_finalize (GObject *object)
+{
+  HCPGridPrivate *priv = HCP_GRID (object)->priv;
+
+  g_array_free (priv->lines, TRUE);
+  g_array_free (priv->row_lines, TRUE);
+
+  G_OBJECT_CLASS (hcp_grid_parent_class)->finalize (object);
 }
 
 static void
 hcp_grid_class_init (HCPGridClass *klass)
 {
+  GObjectClass *g_object_class = (GObjectClass *) klass;
+  GtkWidgetClass *widget_class = (GtkWidgetClass *) klass;
 
-  g_type_class_add_private (klass, sizeof (HCPGridPrivate));
+  g_object_class->dispose = hcp_grid_dispose;
+  g_object_class->finalize = hcp_grid_finalize;
 
+  widget_class->realize = hcp_grid_realize;
+  widget_class->size_allocate = hcp_grid_size_allocate;
+  widget_class->get_preferred_width = hcp_grid_get_preferred_width;
+  widget_class->get_preferred_height = hcp_grid_get_preferred_height;
+  widget_class->draw = hcp_grid_draw;
+  widget_class->button_press_event = hcp_grid_button_press;
+  widget_class->button_release_event = hcp_grid_button_release;
+  widget_class->key_press_event = hcp_grid_key_press;
+  widget_class->focus_in_event = hcp_grid_focus_changed;
+  widget_class->focus_out_event = hcp_grid_focus_changed;
+  widget_class->style_updated = hcp_grid_style_updated;
+
+  gtk_widget_class_set_accessible_type (widget_class,
+                                        hcp_grid_accessible_get_type ());
+
+  signals[SIGNAL_ITEM_ACTIVATED] =
+        g_signal_new ("item-activated",
+                      G_OBJECT_CLASS_TYPE (g_object_class),
+                      G_SIGNAL_RUN_LAST,
+                      G_STRUCT_OFFSET (HCPGridClass, item_activated),
+                      NULL, NULL,
+                      g_cclosure_marshal_VOID__BOXED,
+                      G_TYPE_NONE, 1,
+                      GTK_TYPE_TREE_PATH);
+
+  g_type_class_add_private (klass, sizeof (HCPGridPrivate));
 }
 
 static void
@@ -134,73 +1561,111 @@ hcp_grid_init (HCPGrid *grid)
 {
   grid->priv = HCP_GRID_GET_PRIVATE (grid);
  
-  grid->priv->can_move_focus = FALSE;
-  grid->priv->focused_in = FALSE;
+  grid->priv->model = NULL;
+  grid->priv->cursor = NULL;
+  grid->priv->pressed_row = -1;
 
+  /* Set default column number (for landscape view) */
+  grid->priv->n_columns = 2;
+  grid->priv->item_width = HCP_GRID_ITEM_WIDTH;
   grid->priv->icon_size = HCP_ICON_SIZE;
+  grid->priv->separator_context = NULL;
+  grid->priv->accessible = NULL;
+
+  grid->priv->layout_valid = FALSE;
+  grid->priv->lines = g_array_new (FALSE, FALSE, sizeof (HCPGridLine));
+  grid->priv->row_lines = g_array_new (FALSE, FALSE, sizeof (gint));
+  grid->priv->height = 0;
+
+  gtk_widget_set_has_window (GTK_WIDGET (grid), TRUE);
+  gtk_widget_set_can_focus (GTK_WIDGET (grid), TRUE);
+}
+
+/* The grid holds a reference on model */
+void
+hcp_grid_set_model (HCPGrid *grid, GtkTreeModel *model)
+{
+  HCPGridPrivate *priv;
+
+  g_return_if_fail (grid);
+  g_return_if_fail (HCP_IS_GRID (grid));
 
-  grid->priv->pixbuf_cell = gtk_cell_renderer_pixbuf_new ();
-  gtk_cell_renderer_set_fixed_size (grid->priv->pixbuf_cell,
-									HCP_ICON_SIZE+2*HCP_GRID_X_PADDING , -1);
+  priv = grid->priv;
 
-  gtk_cell_layout_pack_start (GTK_CELL_LAYOUT (grid), 
-		  	      grid->priv->pixbuf_cell, 
-			      FALSE);
+  if (model == priv->model)
+    return;
 
-  g_object_set (grid->priv->pixbuf_cell, 
-		"xpad", HCP_GRID_X_PADDING, 
-		"ypad", HCP_GRID_Y_PADDING, 
-                NULL);
+  if (priv->cursor)
+  {
+    gtk_tree_row_reference_free (priv->cursor);
+    priv->cursor = NULL;
+  }
+
+  if (priv->model)
+  {
+    g_signal_handlers_disconnect_matched (priv->model,
+                                          G_SIGNAL_MATCH_DATA,
+                                          0, 0, NULL, NULL,
+                                          grid);
+    g_object_unref (priv->model);
+  }
 
-  gtk_cell_layout_set_attributes (GTK_CELL_LAYOUT (grid),
-                                  grid->priv->pixbuf_cell, 
-                                  "pixbuf", 0,
-                                  NULL);
+  priv->model = model;
 
-  grid->priv->text_cell = gtk_cell_renderer_text_new ();
-  gtk_cell_renderer_set_fixed_size (grid->priv->text_cell, 300 , 60);
+  if (model)
+  {
+    g_object_ref (model);
 
-  /* NOTE: it seems that text truncation only works with GtkLabel */
-  g_object_set (G_OBJECT(grid->priv->text_cell), "ellipsize", PANGO_ELLIPSIZE_END, NULL);
+    g_signal_connect (model, "row-changed",
+                      G_CALLBACK (hcp_grid_row_changed_cb), grid);
+    g_signal_connect (model, "row-inserted",
+                      G_CALLBACK (hcp_grid_row_inserted_cb), grid);
+    g_signal_connect (model, "row-deleted",
+                      G_CALLBACK (hcp_grid_row_deleted_cb), grid);
+    g_signal_connect (model, "rows-reordered",
+                      G_CALLBACK (hcp_grid_rows_reordered_cb), grid);
+  }
 
-  gtk_cell_layout_pack_start (GTK_CELL_LAYOUT (grid), 
-		  	      grid->priv->text_cell, 
-			      FALSE);
+  hcp_grid_invalidate_layout (grid);
+  hcp_grid_accessible_model_changed (grid);
+}
 
-  g_object_set (grid->priv->text_cell, 
-                "yalign", 0.5,
-                NULL);
+GtkTreeModel *
+hcp_grid_get_model (HCPGrid *grid)
+{
+  g_return_val_if_fail (grid, NULL);
+  g_return_val_if_fail (HCP_IS_GRID (grid), NULL);
 
-  gtk_cell_layout_set_attributes (GTK_CELL_LAYOUT (grid),
-                                  grid->priv->text_cell, 
-				  "text", 1, 
-				  NULL);  
+  return grid->priv->model;
+}
 
-  gtk_icon_view_set_margin (GTK_ICON_VIEW (grid), 0);
+/* Only the layout changes, the pixbufs in the model are kept */
+void
+hcp_grid_set_columns (HCPGrid *grid, gint n_columns, gint item_width)
+{
+  g_return_if_fail (grid);
+  g_return_if_fail (HCP_IS_GRID (grid));
+  g_return_if_fail (n_columns > 0);
 
-  gtk_icon_view_set_column_spacing (GTK_ICON_VIEW (grid), HILDON_MARGIN_DOUBLE);
-  gtk_icon_view_set_row_spacing (GTK_ICON_VIEW (grid), 0);
-  gtk_icon_view_set_spacing (GTK_ICON_VIEW (grid), 6);
+  if (n_columns == grid->priv->n_columns &&
+      item_width == grid->priv->item_width)
+    return;
 
-  gtk_icon_view_set_item_orientation (GTK_ICON_VIEW (grid), 
-                                      GTK_ORIENTATION_HORIZONTAL);
+  grid->priv->n_columns = n_columns;
+  grid->priv->item_width = item_width;
 
-  /* Set default column number (for landscape view) */
-  gtk_icon_view_set_columns (GTK_ICON_VIEW (grid), 2);
+  hcp_grid_invalidate_layout (grid);
 }
 
+/* Moves the cursor to path, which has to be an item */
 void
-hcp_grid_refresh_icons (HCPGrid* grid)
-{ 
-  GtkTreeModel* model;
-
-  model = gtk_icon_view_get_model (GTK_ICON_VIEW (grid));
-  gtk_tree_model_foreach (model, hcp_grid_update_icon, grid);
-  GtkRequisition req;
-  gtk_widget_get_preferred_size (GTK_WIDGET(grid), &req, NULL);
-  GtkAllocation alloc = {0,0,req.width, req.height};
-  gtk_widget_size_allocate (GTK_WIDGET(grid), &alloc);
-  gtk_widget_queue_resize (GTK_WIDGET (grid));
+hcp_grid_select_path (HCPGrid *grid, GtkTreePath *path)
+{
+  g_return_if_fail (grid);
+  g_return_if_fail (HCP_IS_GRID (grid));
+  g_return_if_fail (path);
+
+  hcp_grid_set_cursor_row (grid, gtk_tree_path_get_indices (path)[0]);
 }
 
 GtkWidget *
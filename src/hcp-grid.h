@@ -25,6 +25,7 @@
 #define HCP_GRID_H
 
 #include <gtk/gtk.h>
+#include <hildon/hildon-defines.h>
 
 G_BEGIN_DECLS
 
@@ -37,19 +38,25 @@ typedef struct _HCPGridPrivate HCPGridPrivate;
 #define HCP_IS_GRID_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), HCP_TYPE_GRID))
 #define HCP_GRID_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), HCP_TYPE_GRID, HCPGridClass))
 
-#define HCP_DEFAULT_ICON_BASENAME  "filemanager_unknown_file"
-
 typedef struct {
-  GtkIconView parent;
+  GtkWidget parent;
   HCPGridPrivate* priv;
 } HCPGrid;
 
 typedef struct {
-  GtkIconViewClass parent_class;
+  GtkWidgetClass parent_class;
+
+  void (*item_activated) (HCPGrid *grid, GtkTreePath *path);
 } HCPGridClass;
 
 GType hcp_grid_get_type (void);
 
+#define HCP_ICON_SIZE         HILDON_ICON_PIXEL_SIZE_FINGER
+#define HCP_GRID_ITEM_HEIGHT  60
+
+/* Rows with no HCP_STORE_APP are section headers showing their
+ * HCP_STORE_LABEL across the whole width, the others are laid out
+ * in columns */
 typedef enum {
   HCP_STORE_ICON = 0,
   HCP_STORE_LABEL,
@@ -57,8 +64,19 @@ typedef enum {
   HCP_STORE_NUM_COLUMNS
 } HCPStoreColumn;
 
-GtkWidget* hcp_grid_new (void);
-void hcp_grid_refresh_icons (HCPGrid*);
+GtkWidget*    hcp_grid_new          (void);
+
+void          hcp_grid_set_model    (HCPGrid      *grid,
+                                     GtkTreeModel *model);
+
+GtkTreeModel* hcp_grid_get_model    (HCPGrid      *grid);
+
+void          hcp_grid_set_columns  (HCPGrid      *grid,
+                                     gint          n_columns,
+                                     gint          item_width);
+
+void          hcp_grid_select_path  (HCPGrid      *grid,
+                                     GtkTreePath  *path);
 
 G_END_DECLS
 
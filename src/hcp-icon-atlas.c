@@ -0,0 +1,446 @@
+/*
+ * This file is part of hildon-control-panel
+ *
+ * Copyright (C) 2010 Nokia Corporation.
+ *
+ * Contact: Karoliina Salminen <karoliina.t.salminen@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+
+#include "hcp-icon-atlas.h"
+
+#define HCP_ICON_ATLAS_MAGIC    "HCPICONS"
+#define HCP_ICON_ATLAS_VERSION  2  /* 1 could hold fallback icons */
+#define HCP_ICON_ATLAS_SUBDIR   "hildon-control-panel"
+#define HCP_ICON_ATLAS_FILE     "icons.atlas"
+
+/*
+ * File layout (host byte order, the file never leaves the device):
+ *
+ *   HCPIconAtlasHeader
+ *   HCPIconAtlasRecord [n_icons]
+ *   string pool [strings_size], padded to 4 bytes
+ *   pixels [pixels_size]
+ *
+ * Pixels are 8 bit non premultiplied RGBA, the layout of a GdkPixbuf
+ * with alpha, so they are handed out without a copy. Offsets of
+ * pixels are relative to the start of the pixel area.
+ */
+typedef struct {
+  gchar    magic[8];
+  guint32  version;
+  guint32  n_icons;
+  guint32  stamp;
+  guint32  strings_size;
+  guint32  pixels_size;
+} HCPIconAtlasHeader;
+
+typedef struct {
+  guint32  key;
+  guint32  width;
+  guint32  height;
+  guint32  rowstride;
+  guint32  offset;
+} HCPIconAtlasRecord;
+
+struct _HCPIconAtlas {
+  GMappedFile  *mapped;
+  const guchar *pixels;
+
+  /* key -> const HCPIconAtlasRecord* */
+  GHashTable   *records;
+};
+
+static gchar *
+hcp_icon_atlas_get_path (void)
+{
+  return g_build_filename (g_get_user_cache_dir (),
+                           HCP_ICON_ATLAS_SUBDIR,
+                           HCP_ICON_ATLAS_FILE,
+                           NULL);
+}
+
+static gint64
+hcp_icon_atlas_get_mtime (const gchar *path)
+{
+  GStatBuf buf;
+
+  if (g_stat (path, &buf) != 0)
+    return 0;
+
+  return buf.st_mtime;
+}
+
+/* Newest of a search path directory, the themes in it and their
+ * icon-theme.cache, which gtk-update-icon-cache rewrites whenever
+ * icons are installed */
+static gint64
+hcp_icon_atlas_get_dir_stamp (const gchar *dir_path)
+{
+  GDir *dir;
+  const gchar *name;
+  gint64 stamp;
+
+  stamp = hcp_icon_atlas_get_mtime (dir_path);
+
+  dir = g_dir_open (dir_path, 0, NULL);
+
+  if (dir == NULL)
+    return stamp;
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+  {
+    gchar *path = g_build_filename (dir_path, name, NULL);
+    gchar *cache_path = g_build_filename (path, "icon-theme.cache", NULL);
+
+    stamp = MAX (stamp, hcp_icon_atlas_get_mtime (path));
+    stamp = MAX (stamp, hcp_icon_atlas_get_mtime (cache_path));
+
+    g_free (cache_path);
+    g_free (path);
+  }
+
+  g_dir_close (dir);
+
+  return stamp;
+}
+
+/* Identifies the current icon theme and the state of the icons
+ * installed for it */
+gchar *
+hcp_icon_atlas_get_theme_stamp (GtkIconTheme *icon_theme)
+{
+  gchar **search_path;
+  gchar *theme_name = NULL;
+  gchar *stamp_str;
+  gint64 stamp = 0;
+  gint n_elements, i;
+
+  g_return_val_if_fail (icon_theme, NULL);
+
+  gtk_icon_theme_get_search_path (icon_theme, &search_path, &n_elements);
+
+  for (i = 0; i < n_elements; i++)
+    stamp = MAX (stamp, hcp_icon_atlas_get_dir_stamp (search_path[i]));
+
+  g_strfreev (search_path);
+
+  g_object_get (gtk_settings_get_default (),
+                "gtk-icon-theme-name", &theme_name,
+                NULL);
+
+  stamp_str = g_strdup_printf ("%s:%" G_GINT64_FORMAT,
+                               theme_name ? theme_name : "",
+                               stamp);
+
+  g_free (theme_name);
+
+  return stamp_str;
+}
+
+HCPIconAtlas *
+hcp_icon_atlas_load (const gchar *theme_stamp)
+{
+  HCPIconAtlas *atlas;
+  GMappedFile *mapped;
+  const HCPIconAtlasHeader *header;
+  const HCPIconAtlasRecord *records;
+  const gchar *contents;
+  const gchar *strings;
+  const guchar *pixels;
+  gchar *atlas_path;
+  gsize length;
+  guint i;
+
+  g_return_val_if_fail (theme_stamp, NULL);
+
+  atlas_path = hcp_icon_atlas_get_path ();
+
+  /* A missing atlas is not an error, it just means a cold start */
+  mapped = g_mapped_file_new (atlas_path, FALSE, NULL);
+
+  g_free (atlas_path);
+
+  if (!mapped)
+    return NULL;
+
+  contents = g_mapped_file_get_contents (mapped);
+  length = g_mapped_file_get_length (mapped);
+
+  if (length < sizeof (HCPIconAtlasHeader))
+    goto invalid;
+
+  header = (const HCPIconAtlasHeader *) contents;
+
+  if (memcmp (header->magic, HCP_ICON_ATLAS_MAGIC, sizeof (header->magic)) ||
+      header->version != HCP_ICON_ATLAS_VERSION)
+    goto invalid;
+
+  if (header->n_icons > (length - sizeof (HCPIconAtlasHeader)) /
+                        sizeof (HCPIconAtlasRecord))
+    goto invalid;
+
+  if ((guint64) length != sizeof (HCPIconAtlasHeader) +
+                          (guint64) header->n_icons * sizeof (HCPIconAtlasRecord) +
+                          header->strings_size +
+                          header->pixels_size)
+    goto invalid;
+
+  records = (const HCPIconAtlasRecord *) (contents + sizeof (HCPIconAtlasHeader));
+  strings = (const gchar *) (records + header->n_icons);
+  pixels = (const guchar *) (strings + header->strings_size);
+
+  /* The pool must be NUL terminated for the offsets to be safe */
+  if (header->strings_size == 0 ||
+      strings[header->strings_size - 1] != '\0' ||
+      header->stamp >= header->strings_size ||
+      strcmp (strings + header->stamp, theme_stamp))
+    goto invalid;
+
+  atlas = g_new0 (HCPIconAtlas, 1);
+
+  atlas->mapped = mapped;
+  atlas->pixels = pixels;
+  atlas->records = g_hash_table_new (g_str_hash, g_str_equal);
+
+  for (i = 0; i < header->n_icons; i++)
+  {
+    const HCPIconAtlasRecord *record = &records[i];
+
+    if (record->key == 0 ||
+        record->key >= header->strings_size ||
+        record->width == 0 || record->height == 0 ||
+        record->rowstride / 4 < record->width ||
+        (guint64) record->offset +
+        (guint64) record->rowstride * record->height > header->pixels_size)
+    {
+      hcp_icon_atlas_free (atlas);
+      g_debug ("Ignoring corrupted icon atlas");
+
+      return NULL;
+    }
+
+    g_hash_table_insert (atlas->records,
+                         (gpointer) (strings + record->key),
+                         (gpointer) record);
+  }
+
+  return atlas;
+
+invalid:
+  g_debug ("Ignoring icon atlas");
+
+  g_mapped_file_unref (mapped);
+
+  return NULL;
+}
+
+static void
+hcp_icon_atlas_release_pixels (guchar *pixels, GMappedFile *mapped)
+{
+  g_mapped_file_unref (mapped);
+}
+
+/* Returns a new pixbuf using the mapped pixels, which stay valid for
+ * as long as the pixbuf, or NULL if key is not in the atlas */
+GdkPixbuf *
+hcp_icon_atlas_lookup (HCPIconAtlas *atlas, const gchar *key)
+{
+  const HCPIconAtlasRecord *record;
+
+  g_return_val_if_fail (atlas, NULL);
+  g_return_val_if_fail (key, NULL);
+
+  record = g_hash_table_lookup (atlas->records, key);
+
+  if (record == NULL)
+    return NULL;
+
+  return gdk_pixbuf_new_from_data (atlas->pixels + record->offset,
+                                   GDK_COLORSPACE_RGB,
+                                   TRUE,
+                                   8,
+                                   record->width,
+                                   record->height,
+                                   record->rowstride,
+                                   (GdkPixbufDestroyNotify) hcp_icon_atlas_release_pixels,
+                                   g_mapped_file_ref (atlas->mapped));
+}
+
+void
+hcp_icon_atlas_free (HCPIconAtlas *atlas)
+{
+  g_return_if_fail (atlas);
+
+  g_hash_table_destroy (atlas->records);
+
+  /* Pixbufs handed out keep their own reference */
+  g_mapped_file_unref (atlas->mapped);
+
+  g_free (atlas);
+}
+
+static guint32
+hcp_icon_atlas_add_string (GByteArray *pool, const gchar *value)
+{
+  guint32 offset = pool->len;
+
+  g_byte_array_append (pool, (const guint8 *) value, strlen (value) + 1);
+
+  return offset;
+}
+
+/* Appends the pixels of pixbuf as tightly packed RGBA rows */
+static gboolean
+hcp_icon_atlas_add_pixels (GByteArray         *pixels,
+                           GdkPixbuf          *pixbuf,
+                           HCPIconAtlasRecord *record)
+{
+  GdkPixbuf *rgba;
+  const guchar *src;
+  guint row;
+
+  if (gdk_pixbuf_get_colorspace (pixbuf) != GDK_COLORSPACE_RGB ||
+      gdk_pixbuf_get_bits_per_sample (pixbuf) != 8)
+    return FALSE;
+
+  if (gdk_pixbuf_get_has_alpha (pixbuf))
+    rgba = g_object_ref (pixbuf);
+  else
+    rgba = gdk_pixbuf_add_alpha (pixbuf, FALSE, 0, 0, 0);
+
+  record->width = gdk_pixbuf_get_width (rgba);
+  record->height = gdk_pixbuf_get_height (rgba);
+  record->rowstride = record->width * 4;
+  record->offset = pixels->len;
+
+  src = gdk_pixbuf_get_pixels (rgba);
+
+  for (row = 0; row < record->height; row++)
+  {
+    g_byte_array_append (pixels,
+                         src + row * gdk_pixbuf_get_rowstride (rgba),
+                         record->rowstride);
+  }
+
+  g_object_unref (rgba);
+
+  return TRUE;
+}
+
+/* icons maps keys to GdkPixbuf, NULL values are skipped */
+gboolean
+hcp_icon_atlas_save (const gchar *theme_stamp, GHashTable *icons)
+{
+  HCPIconAtlasHeader header;
+  GByteArray *data;
+  GByteArray *strings;
+  GByteArray *pixels;
+  GHashTableIter iter;
+  gpointer key, value;
+  gchar *atlas_path;
+  gchar *atlas_dir;
+  GError *error = NULL;
+  gboolean ret;
+
+  g_return_val_if_fail (theme_stamp, FALSE);
+  g_return_val_if_fail (icons, FALSE);
+
+  strings = g_byte_array_new ();
+  pixels = g_byte_array_new ();
+
+  /* offset 0 is reserved for "no key" */
+  g_byte_array_append (strings, (const guint8 *) "", 1);
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, HCP_ICON_ATLAS_MAGIC, sizeof (header.magic));
+  header.version = HCP_ICON_ATLAS_VERSION;
+  header.stamp = hcp_icon_atlas_add_string (strings, theme_stamp);
+
+  data = g_byte_array_sized_new (sizeof (HCPIconAtlasHeader) +
+                                 g_hash_table_size (icons) *
+                                 sizeof (HCPIconAtlasRecord));
+
+  g_byte_array_set_size (data, sizeof (HCPIconAtlasHeader));
+
+  g_hash_table_iter_init (&iter, icons);
+
+  while (g_hash_table_iter_next (&iter, &key, &value))
+  {
+    HCPIconAtlasRecord record;
+
+    if (value == NULL)
+      continue;
+
+    memset (&record, 0, sizeof (record));
+
+    if (!hcp_icon_atlas_add_pixels (pixels, GDK_PIXBUF (value), &record))
+      continue;
+
+    record.key = hcp_icon_atlas_add_string (strings, key);
+
+    g_byte_array_append (data, (const guint8 *) &record, sizeof (record));
+    header.n_icons++;
+  }
+
+  /* Keeps the pixel rows 4 byte aligned */
+  while (strings->len % 4)
+    g_byte_array_append (strings, (const guint8 *) "", 1);
+
+  header.strings_size = strings->len;
+  header.pixels_size = pixels->len;
+  memcpy (data->data, &header, sizeof (header));
+
+  g_byte_array_append (data, strings->data, strings->len);
+  g_byte_array_append (data, pixels->data, pixels->len);
+
+  atlas_path = hcp_icon_atlas_get_path ();
+  atlas_dir = g_path_get_dirname (atlas_path);
+
+  g_mkdir_with_parents (atlas_dir, 0755);
+
+  /* g_file_set_contents() renames into place, so the atlas mapped by
+   * a running instance is left untouched */
+  ret = g_file_set_contents (atlas_path,
+                             (const gchar *) data->data,
+                             data->len,
+                             &error);
+
+  if (!ret)
+  {
+    g_warning ("Error writing icon atlas: %s", error->message);
+    g_error_free (error);
+  }
+
+  g_free (atlas_dir);
+  g_free (atlas_path);
+  g_byte_array_free (strings, TRUE);
+  g_byte_array_free (pixels, TRUE);
+  g_byte_array_free (data, TRUE);
+
+  return ret;
+}
@@ -0,0 +1,58 @@
+/*
+ * This file is part of hildon-control-panel
+ *
+ * Copyright (C) 2010 Nokia Corporation.
+ *
+ * Contact: Karoliina Salminen <karoliina.t.salminen@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef HCP_ICON_ATLAS_H
+#define HCP_ICON_ATLAS_H
+
+#include <glib.h>
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Pre-scaled RGBA pixels of the icons the control panel showed last
+ * time, stored in a single file under the user cache dir and mapped
+ * on load, so icons come back without being decoded or rasterized.
+ * The file is only valid for the icon theme stamp it was written
+ * with.
+ *
+ * Icons are keyed by the strings the caller chose when saving.
+ */
+
+typedef struct _HCPIconAtlas HCPIconAtlas;
+
+gchar*         hcp_icon_atlas_get_theme_stamp (GtkIconTheme *icon_theme);
+
+HCPIconAtlas*  hcp_icon_atlas_load            (const gchar  *theme_stamp);
+
+GdkPixbuf*     hcp_icon_atlas_lookup          (HCPIconAtlas *atlas,
+                                               const gchar  *key);
+
+void           hcp_icon_atlas_free            (HCPIconAtlas *atlas);
+
+gboolean       hcp_icon_atlas_save            (const gchar  *theme_stamp,
+                                               GHashTable   *icons);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,574 @@
+/*
+ * This file is part of hildon-control-panel
+ *
+ * Copyright (C) 2010 Nokia Corporation.
+ *
+ * Contact: Karoliina Salminen <karoliina.t.salminen@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtk/gtk.h>
+
+#include "hcp-icon-cache.h"
+#include "hcp-icon-atlas.h"
+#include "hcp-marshalers.h"
+#include "hcp-trace.h"
+
+#define HCP_ICON_CACHE_GET_PRIVATE(object) \
+        (G_TYPE_INSTANCE_GET_PRIVATE ((object), HCP_TYPE_ICON_CACHE, HCPIconCachePrivate))
+
+G_DEFINE_TYPE (HCPIconCache, hcp_icon_cache, G_TYPE_OBJECT);
+
+typedef enum
+{
+  SIGNAL_ICON_LOADED,
+  SIGNAL_CHANGED,
+  N_SIGNALS
+} HCPIconCacheSignals;
+
+static gint signals[N_SIGNALS];
+
+/* One icon decoded in a worker thread. The file is looked up in the
+ * theme on the main thread, GtkIconTheme is not thread safe. */
+typedef struct
+{
+  HCPIconCache *cache;
+  guint         serial;
+  gchar        *key;
+  gchar        *name;
+  gint          size;
+  gchar        *filename;
+  GdkPixbuf    *pixbuf;
+  GError       *error;
+} HCPIconLoadJob;
+
+struct _HCPIconCachePrivate
+{
+  GtkIconTheme *icon_theme;
+  GThreadPool  *pool;
+
+  /* "name:size" -> GdkPixbuf, NULL while the load is in flight */
+  GHashTable   *icons;
+
+  /* Bumped when the theme changes so that the results of loads
+   * started before are thrown away */
+  guint         serial;
+
+  /* Icons decoded by earlier runs. A new atlas is written once the
+   * loads in flight settle after anything had to be decoded. */
+  HCPIconAtlas *atlas;
+  gchar        *theme_stamp;
+  guint         n_loading;
+  guint         save_id;
+};
+
+static gchar *
+hcp_icon_cache_make_key (const gchar *name, gint size)
+{
+  return g_strdup_printf ("%s:%d", name, size);
+}
+
+static void
+hcp_icon_cache_unref_pixbuf (GdkPixbuf *pixbuf)
+{
+  if (pixbuf)
+    g_object_unref (pixbuf);
+}
+
+/* Whether the entry of key only holds the fallback of its size, as
+ * icons that were missing or failed to decode do */
+static gboolean
+hcp_icon_cache_is_fallback (HCPIconCache *cache,
+                            const gchar  *key,
+                            GdkPixbuf    *pixbuf)
+{
+  const gchar *size = strrchr (key, ':');
+  gchar *fallback_key;
+  gboolean ret;
+
+  if (size == NULL)
+    return FALSE;
+
+  fallback_key = hcp_icon_cache_make_key (HCP_DEFAULT_ICON_BASENAME,
+                                          atoi (size + 1));
+
+  ret = strcmp (key, fallback_key) != 0 &&
+        g_hash_table_lookup (cache->priv->icons, fallback_key) == pixbuf;
+
+  g_free (fallback_key);
+
+  return ret;
+}
+
+static gboolean
+hcp_icon_cache_save_atlas (HCPIconCache *cache)
+{
+  HCPIconCachePrivate *priv = cache->priv;
+  GHashTable *decoded;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  priv->save_id = 0;
+
+  /* The last load to finish queues it again */
+  if (priv->n_loading > 0)
+    return FALSE;
+
+  /* Only real pixbufs are saved. A fallback in the atlas would keep
+   * the theme from being asked again on later starts. */
+  decoded = g_hash_table_new (g_str_hash, g_str_equal);
+
+  g_hash_table_iter_init (&iter, priv->icons);
+
+  while (g_hash_table_iter_next (&iter, &key, &value))
+  {
+    if (value && !hcp_icon_cache_is_fallback (cache, key, value))
+      g_hash_table_insert (decoded, key, value);
+  }
+
+  hcp_icon_atlas_save (priv->theme_stamp, decoded);
+
+  g_hash_table_destroy (decoded);
+
+  return FALSE;
+}
+
+/* Called whenever a pixbuf had to be decoded */
+static void
+hcp_icon_cache_queue_save_atlas (HCPIconCache *cache)
+{
+  HCPIconCachePrivate *priv = cache->priv;
+
+  if (priv->n_loading > 0 || priv->save_id != 0)
+    return;
+
+  priv->save_id = g_idle_add_full (G_PRIORITY_LOW,
+                                   (GSourceFunc) hcp_icon_cache_save_atlas,
+                                   cache,
+                                   NULL);
+}
+
+/* Returns a new reference to the atlas copy of key, if any */
+static GdkPixbuf *
+hcp_icon_cache_lookup_atlas (HCPIconCache *cache, const gchar *key)
+{
+  if (cache->priv->atlas == NULL)
+    return NULL;
+
+  return hcp_icon_atlas_lookup (cache->priv->atlas, key);
+}
+
+static void
+hcp_icon_cache_free_job (HCPIconLoadJob *job)
+{
+  if (job->pixbuf)
+    g_object_unref (job->pixbuf);
+
+  if (job->error)
+    g_error_free (job->error);
+
+  g_object_unref (job->cache);
+
+  g_free (job->key);
+  g_free (job->name);
+  g_free (job->filename);
+  g_free (job);
+}
+
+/* Loaded synchronously, once per size, as it stands in for every
+ * icon that is still loading or could not be found */
+static GdkPixbuf *
+hcp_icon_cache_get_fallback (HCPIconCache *cache, gint size)
+{
+  HCPIconCachePrivate *priv = cache->priv;
+  GdkPixbuf *pixbuf;
+  GError *error = NULL;
+  gpointer cached;
+  gchar *key;
+
+  key = hcp_icon_cache_make_key (HCP_DEFAULT_ICON_BASENAME, size);
+
+  if (g_hash_table_lookup_extended (priv->icons, key, NULL, &cached))
+  {
+    g_free (key);
+    return cached;
+  }
+
+  pixbuf = hcp_icon_cache_lookup_atlas (cache, key);
+
+  if (pixbuf)
+  {
+    g_hash_table_insert (priv->icons, key, pixbuf);
+    return pixbuf;
+  }
+
+  pixbuf = gtk_icon_theme_load_icon (priv->icon_theme,
+                                     HCP_DEFAULT_ICON_BASENAME,
+                                     size,
+                                     0,
+                                     &error);
+
+  if (pixbuf == NULL)
+  {
+    g_warning ("Couldn't load default icon: %s", error->message);
+    g_error_free (error);
+  }
+  else
+  {
+    hcp_icon_cache_queue_save_atlas (cache);
+  }
+
+  /* A failure is remembered too */
+  g_hash_table_insert (priv->icons, key, pixbuf);
+
+  return pixbuf;
+}
+
+/* Stores pixbuf, or the fallback if it is NULL, as the icon of key */
+static GdkPixbuf *
+hcp_icon_cache_store (HCPIconCache *cache,
+                      gchar        *key,
+                      gint          size,
+                      GdkPixbuf    *pixbuf)
+{
+  if (pixbuf == NULL)
+  {
+    pixbuf = hcp_icon_cache_get_fallback (cache, size);
+
+    if (pixbuf)
+      g_object_ref (pixbuf);
+  }
+
+  g_hash_table_replace (cache->priv->icons, key, pixbuf);
+
+  return pixbuf;
+}
+
+static gboolean
+hcp_icon_cache_job_done (HCPIconLoadJob *job)
+{
+  HCPIconCache *cache = job->cache;
+
+  /* The theme changed meanwhile, the icon is looked up again on
+   * the next request */
+  if (job->serial == cache->priv->serial)
+  {
+    cache->priv->n_loading--;
+
+    if (job->pixbuf == NULL)
+      g_warning ("Couldn't load icon \"%s\": %s",
+                 job->name, job->error->message);
+
+    hcp_icon_cache_store (cache, job->key, job->size, job->pixbuf);
+
+    /* Now owned by the table */
+    job->key = NULL;
+    job->pixbuf = NULL;
+
+    g_signal_emit (G_OBJECT (cache),
+                   signals[SIGNAL_ICON_LOADED],
+                   0,
+                   job->name,
+                   job->size);
+
+    hcp_icon_cache_queue_save_atlas (cache);
+  }
+
+  hcp_icon_cache_free_job (job);
+
+  return FALSE;
+}
+
+/* Runs in a worker thread, only touches the job itself */
+static void
+hcp_icon_cache_run_job (HCPIconLoadJob *job, gpointer user_data)
+{
+  hcp_trace_begin ("icon_decode", job->name);
+
+  job->pixbuf = gdk_pixbuf_new_from_file_at_size (job->filename,
+                                                  job->size,
+                                                  job->size,
+                                                  &job->error);
+
+  hcp_trace_end ("icon_decode");
+
+  g_idle_add ((GSourceFunc) hcp_icon_cache_job_done, job);
+}
+
+/* Queues the load of an icon missing from the cache. Returns the
+ * pixbuf if it could be produced right away. */
+static GdkPixbuf *
+hcp_icon_cache_load (HCPIconCache *cache,
+                     gchar        *key,
+                     const gchar  *name,
+                     gint          size)
+{
+  HCPIconCachePrivate *priv = cache->priv;
+  HCPIconLoadJob *job;
+  GtkIconInfo *info;
+  GdkPixbuf *pixbuf = NULL;
+  GError *error = NULL;
+
+  pixbuf = hcp_icon_cache_lookup_atlas (cache, key);
+
+  if (pixbuf)
+    return hcp_icon_cache_store (cache, key, size, pixbuf);
+
+  info = gtk_icon_theme_lookup_icon (priv->icon_theme, name, size, 0);
+
+  if (info == NULL)
+  {
+    g_warning ("Couldn't load icon \"%s\": not found in the icon theme",
+               name);
+
+    return hcp_icon_cache_store (cache, key, size, NULL);
+  }
+
+  /* Builtin icons have no file and are cheap to get */
+  if (priv->pool == NULL || gtk_icon_info_get_filename (info) == NULL)
+  {
+    pixbuf = gtk_icon_info_load_icon (info, &error);
+
+    if (pixbuf == NULL)
+    {
+      g_warning ("Couldn't load icon \"%s\": %s", name, error->message);
+      g_error_free (error);
+    }
+    else
+    {
+      hcp_icon_cache_queue_save_atlas (cache);
+    }
+
+    gtk_icon_info_free (info);
+
+    return hcp_icon_cache_store (cache, key, size, pixbuf);
+  }
+
+  job = g_new0 (HCPIconLoadJob, 1);
+
+  job->cache = g_object_ref (cache);
+  job->serial = priv->serial;
+  job->key = g_strdup (key);
+  job->name = g_strdup (name);
+  job->size = size;
+  job->filename = g_strdup (gtk_icon_info_get_filename (info));
+
+  gtk_icon_info_free (info);
+
+  /* Marks the load as in flight */
+  g_hash_table_insert (priv->icons, key, NULL);
+  priv->n_loading++;
+
+  g_thread_pool_push (priv->pool, job, NULL);
+
+  return hcp_icon_cache_get_fallback (cache, size);
+}
+
+static void
+hcp_icon_cache_load_atlas (HCPIconCache *cache)
+{
+  HCPIconCachePrivate *priv = cache->priv;
+
+  if (priv->atlas)
+    hcp_icon_atlas_free (priv->atlas);
+
+  g_free (priv->theme_stamp);
+
+  priv->theme_stamp = hcp_icon_atlas_get_theme_stamp (priv->icon_theme);
+  hcp_trace_begin ("icon_atlas_load", NULL);
+  priv->atlas = hcp_icon_atlas_load (priv->theme_stamp);
+  hcp_trace_end ("icon_atlas_load");
+}
+
+static void
+hcp_icon_cache_theme_changed_cb (GtkIconTheme *icon_theme,
+                                 HCPIconCache *cache)
+{
+  HCPIconCachePrivate *priv = cache->priv;
+
+  priv->serial++;
+  priv->n_loading = 0;
+
+  if (priv->save_id)
+  {
+    g_source_remove (priv->save_id);
+    priv->save_id = 0;
+  }
+
+  g_hash_table_remove_all (priv->icons);
+
+  /* Most likely stale now */
+  hcp_icon_cache_load_atlas (cache);
+
+  g_signal_emit (G_OBJECT (cache),
+                 signals[SIGNAL_CHANGED],
+                 0);
+}
+
+static void
+hcp_icon_cache_init (HCPIconCache *cache)
+{
+  GError *error = NULL;
+
+  cache->priv = HCP_ICON_CACHE_GET_PRIVATE (cache);
+
+  cache->priv->serial = 0;
+  cache->priv->icons = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                              g_free,
+                                              (GDestroyNotify) hcp_icon_cache_unref_pixbuf);
+
+  cache->priv->icon_theme = gtk_icon_theme_get_default ();
+
+  cache->priv->atlas = NULL;
+  cache->priv->theme_stamp = NULL;
+  cache->priv->n_loading = 0;
+  cache->priv->save_id = 0;
+
+  hcp_icon_cache_load_atlas (cache);
+
+  g_signal_connect (cache->priv->icon_theme, "changed",
+                    G_CALLBACK (hcp_icon_cache_theme_changed_cb),
+                    cache);
+
+  cache->priv->pool = g_thread_pool_new ((GFunc) hcp_icon_cache_run_job,
+                                         NULL,
+                                         g_get_num_processors (),
+                                         FALSE,
+                                         &error);
+
+  if (error)
+  {
+    /* Icons are then loaded on the main thread */
+    g_warning ("Error starting icon loader threads: %s", error->message);
+    g_error_free (error);
+
+    cache->priv->pool = NULL;
+  }
+}
+
+static void
+hcp_icon_cache_finalize (GObject *object)
+{
+  HCPIconCachePrivate *priv;
+
+  g_return_if_fail (object);
+  g_return_if_fail (HCP_IS_ICON_CACHE (object));
+
+  priv = HCP_ICON_CACHE (object)->priv;
+
+  /* Jobs keep the cache alive, none is left at this point */
+  if (priv->pool)
+    g_thread_pool_free (priv->pool, TRUE, FALSE);
+
+  g_signal_handlers_disconnect_by_func (priv->icon_theme,
+                                        hcp_icon_cache_theme_changed_cb,
+                                        object);
+
+  if (priv->save_id)
+    g_source_remove (priv->save_id);
+
+  g_hash_table_destroy (priv->icons);
+
+  if (priv->atlas)
+    hcp_icon_atlas_free (priv->atlas);
+
+  g_free (priv->theme_stamp);
+
+  G_OBJECT_CLASS (hcp_icon_cache_parent_class)->finalize (object);
+}
+
+static void
+hcp_icon_cache_class_init (HCPIconCacheClass *class)
+{
+  GObjectClass *g_object_class = (GObjectClass *) class;
+
+  g_object_class->finalize = hcp_icon_cache_finalize;
+
+  signals[SIGNAL_ICON_LOADED] =
+        g_signal_new ("icon-loaded",
+                      G_OBJECT_CLASS_TYPE (g_object_class),
+                      G_SIGNAL_RUN_FIRST,
+                      G_STRUCT_OFFSET (HCPIconCacheClass, icon_loaded),
+                      NULL, NULL,
+                      hcp_marshal_VOID__STRING_INT,
+                      G_TYPE_NONE, 2,
+                      G_TYPE_STRING,
+                      G_TYPE_INT);
+
+  signals[SIGNAL_CHANGED] =
+        g_signal_new ("changed",
+                      G_OBJECT_CLASS_TYPE (g_object_class),
+                      G_SIGNAL_RUN_FIRST,
+                      G_STRUCT_OFFSET (HCPIconCacheClass, changed),
+                      NULL, NULL,
+                      g_cclosure_marshal_VOID__VOID,
+                      G_TYPE_NONE, 0);
+
+  g_type_class_add_private (g_object_class, sizeof (HCPIconCachePrivate));
+}
+
+/* Shared by all the grids of the process */
+HCPIconCache *
+hcp_icon_cache_get_default (void)
+{
+  static HCPIconCache *instance;
+
+  if (!instance)
+  {
+    instance = HCP_ICON_CACHE (g_object_new (HCP_TYPE_ICON_CACHE, NULL));
+  }
+
+  return instance;
+}
+
+/* Never decodes an icon on the calling thread, except the default
+ * one. While name is loading, or if it could not be loaded, the
+ * default icon is returned and "icon-loaded" is emitted once the
+ * real one is in. The pixbuf is owned by the cache. */
+GdkPixbuf *
+hcp_icon_cache_lookup (HCPIconCache *cache,
+                       const gchar  *name,
+                       gint          size)
+{
+  gpointer cached;
+  gchar *key;
+
+  g_return_val_if_fail (cache, NULL);
+  g_return_val_if_fail (HCP_IS_ICON_CACHE (cache), NULL);
+
+  if (name == NULL || *name == '\0' ||
+      !strcmp (name, HCP_DEFAULT_ICON_BASENAME))
+    return hcp_icon_cache_get_fallback (cache, size);
+
+  key = hcp_icon_cache_make_key (name, size);
+
+  if (g_hash_table_lookup_extended (cache->priv->icons, key, NULL, &cached))
+  {
+    g_free (key);
+
+    return cached ? cached : hcp_icon_cache_get_fallback (cache, size);
+  }
+
+  return hcp_icon_cache_load (cache, key, name, size);
+}
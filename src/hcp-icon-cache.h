@@ -0,0 +1,76 @@
+/*
+ * This file is part of hildon-control-panel
+ *
+ * Copyright (C) 2010 Nokia Corporation.
+ *
+ * Contact: Karoliina Salminen <karoliina.t.salminen@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef HCP_ICON_CACHE_H
+#define HCP_ICON_CACHE_H
+
+#include <glib.h>
+#include <glib-object.h>
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+#define HCP_DEFAULT_ICON_BASENAME  "filemanager_unknown_file"
+
+typedef struct _HCPIconCache HCPIconCache;
+typedef struct _HCPIconCacheClass HCPIconCacheClass;
+typedef struct _HCPIconCachePrivate HCPIconCachePrivate;
+
+#define HCP_TYPE_ICON_CACHE            (hcp_icon_cache_get_type ())
+#define HCP_ICON_CACHE(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), HCP_TYPE_ICON_CACHE, HCPIconCache))
+#define HCP_ICON_CACHE_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass),  HCP_TYPE_ICON_CACHE, HCPIconCacheClass))
+#define HCP_IS_ICON_CACHE(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), HCP_TYPE_ICON_CACHE))
+#define HCP_IS_ICON_CACHE_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass),  HCP_TYPE_ICON_CACHE))
+#define HCP_ICON_CACHE_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj),  HCP_TYPE_ICON_CACHE, HCPIconCacheClass))
+
+struct _HCPIconCache
+{
+  GObject gobject;
+
+  HCPIconCachePrivate *priv;
+};
+
+struct _HCPIconCacheClass
+{
+  GObjectClass parent_class;
+
+  /* Emitted on the main thread once a pixbuf loaded in the
+   * background replaced the placeholder of name at size */
+  void (*icon_loaded) (HCPIconCache *cache, const gchar *name, gint size);
+
+  /* Emitted when the icon theme changed and every cached pixbuf
+   * was dropped */
+  void (*changed)     (HCPIconCache *cache);
+};
+
+GType          hcp_icon_cache_get_type    (void);
+
+HCPIconCache*  hcp_icon_cache_get_default (void);
+
+GdkPixbuf*     hcp_icon_cache_lookup      (HCPIconCache *cache,
+                                           const gchar  *name,
+                                           gint          size);
+
+G_END_DECLS
+
+#endif
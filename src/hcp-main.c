@@ -34,11 +34,14 @@
 #include <hildon/hildon.h>
 
 #include "hcp-program.h"
+#include "hcp-trace.h"
 
 int main (int argc, char **argv)
 {
   HCPProgram *program = NULL; 
 
+  hcp_trace_init ();
+
   setlocale (LC_ALL, "");
 
   bindtextdomain (PACKAGE, LOCALEDIR);
@@ -49,21 +52,28 @@ int main (int argc, char **argv)
 
   /* Initialize before calling any glib function */
  /* if (!g_thread_supported ()) g_thread_init (NULL);*/
+
+  /* Starts reading the applets in the background, before GTK+ is
+   * initialized, the locale has to be set already */
+  program = hcp_program_get_instance ();
   
+  hcp_trace_begin ("gtk_init", NULL);
   gtk_init (&argc, &argv);
   hildon_init();
+  hcp_trace_end ("gtk_init");
   
 
   /* Set application name to "" as we only need 
    * the window title in the title bar */
   g_set_application_name ("");
 
-  program = hcp_program_get_instance ();
-
   hcp_program_run (program);
 
   gtk_main();
 
+  /* Everything up to now, icon loads included */
+  hcp_trace_write ();
+
   g_object_unref (program);
 
   return 0;
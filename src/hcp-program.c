@@ -36,6 +36,7 @@
 #include "hcp-window.h"
 #include "hcp-app-list.h"
 #include "hcp-app.h"
+#include "hcp-trace.h"
 
 G_DEFINE_TYPE (HCPProgram, hcp_program, G_TYPE_OBJECT);
 
@@ -169,6 +170,9 @@ hcp_program_rpc_handler (const gchar *interface,
   }
   else if ((!strcmp (method, HCP_RPC_METHOD_TOP_APPLICATION)))
   {
+    /* The language may have been switched while we were away */
+    hcp_app_list_check_locale (program->al);
+
     if (!program->window)
       hcp_program_show_window (program);
     else
@@ -192,7 +196,9 @@ hcp_program_init_rpc (HCPProgram *program)
   g_return_if_fail (program);
   g_return_if_fail (HCP_IS_PROGRAM (program));
 
+  hcp_trace_begin ("osso_initialize", NULL);
   program->osso = osso_initialize (HCP_APP_NAME, HCP_APP_VERSION, TRUE, NULL);
+  hcp_trace_end ("osso_initialize");
   
   if (!program->osso)
   {
@@ -229,7 +235,11 @@ hcp_program_init (HCPProgram *program)
   program->execute = 0;
 
   program->al = (HCPAppList *) hcp_app_list_new ();
-  hcp_app_list_update (program->al);
+
+  /* The applet directories are read in the background while libosso
+   * connects and GTK+ and the window start up, see
+   * hcp_program_run () */
+  hcp_app_list_start_update (program->al);
 
   hcp_program_init_rpc (program);
 
@@ -306,5 +316,9 @@ hcp_program_run (HCPProgram *program)
 
   /* Always start the user interface for now */
   hcp_program_show_window (program);
+
+  /* Joins the directory reader, before the first frame and the first
+   * RPC call. The window gets the applets through "apps-changed". */
+  hcp_app_list_update (program->al);
 }
 
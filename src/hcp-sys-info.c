@@ -0,0 +1,620 @@
+/*
+ * This file is part of hildon-control-panel
+ *
+ * Copyright (C) 2010 Nokia Corporation.
+ *
+ * Contact: Karoliina Salminen <karoliina.t.salminen@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <dbus/dbus-glib.h>
+
+#include "hcp-sys-info.h"
+#include "hcp-marshalers.h"
+
+#define HCP_SYS_INFO_GET_PRIVATE(object) \
+        (G_TYPE_INSTANCE_GET_PRIVATE ((object), HCP_TYPE_SYS_INFO, HCPSysInfoPrivate))
+
+G_DEFINE_TYPE (HCPSysInfo, hcp_sys_info, G_TYPE_OBJECT);
+
+#define SYSINFO_SERVICE_DBUS "com.nokia.SystemInfo"
+#define SYSINFO_PATH_DBUS "/com/nokia/SystemInfo"
+#define SYSINFO_INTERFACE_DBUS "com.nokia.SystemInfo"
+#define SYSINFO_METHOD "GetConfigValue"
+
+#define BUS_SERVICE_DBUS "org.freedesktop.DBus"
+#define BUS_PATH_DBUS "/org/freedesktop/DBus"
+#define BUS_INTERFACE_DBUS "org.freedesktop.DBus"
+
+/* Set to "session" to query a stand-in SystemInfo on the session bus */
+#define HCP_SYS_INFO_BUS_ENV "HCP_SYSINFO_BUS"
+
+typedef enum
+{
+  SIGNAL_CHANGED,
+  N_SIGNALS
+} HCPSysInfoSignals;
+
+static gint signals[N_SIGNALS];
+
+/* One SystemInfo configuration key, queried at most once unless
+ * the service is restarted */
+typedef struct
+{
+  HCPSysInfo      *info;
+  gchar           *key;
+  HCPSysInfoState  state;
+  GArray          *value;
+  DBusGProxyCall  *call;
+} HCPSysInfoValue;
+
+struct _HCPSysInfoPrivate
+{
+  DBusGProxy *proxy;
+  DBusGProxy *bus_proxy;
+  gboolean    bus_failed;
+
+  /* Calls in flight, and whether a reply changed a value since
+   * "changed" was last emitted */
+  guint       n_pending;
+  gboolean    dirty;
+
+  /* key -> HCPSysInfoValue */
+  GHashTable *values;
+};
+
+static void
+hcp_sys_info_cancel_call (HCPSysInfoValue *value)
+{
+  if (!value->call)
+    return;
+
+  dbus_g_proxy_cancel_call (value->info->priv->proxy, value->call);
+
+  value->call = NULL;
+  value->info->priv->n_pending--;
+}
+
+static void
+hcp_sys_info_free_value (HCPSysInfoValue *value)
+{
+  hcp_sys_info_cancel_call (value);
+
+  if (value->value)
+    g_array_free (value->value, TRUE);
+
+  g_free (value->key);
+  g_free (value);
+}
+
+static gboolean
+hcp_sys_info_same_value (GArray *a, GArray *b)
+{
+  if (a == NULL || b == NULL)
+    return a == b;
+
+  return a->len == b->len && !memcmp (a->data, b->data, a->len);
+}
+
+static void
+hcp_sys_info_reply_cb (DBusGProxy      *proxy,
+                       DBusGProxyCall  *call,
+                       HCPSysInfoValue *value)
+{
+  HCPSysInfoPrivate *priv = value->info->priv;
+  HCPSysInfoState state = HCP_SYS_INFO_AVAILABLE;
+  GArray *array = NULL;
+  GError *error = NULL;
+
+  value->call = NULL;
+  priv->n_pending--;
+
+  if (!dbus_g_proxy_end_call (proxy, call, &error,
+                              dbus_g_type_get_collection ("GArray", G_TYPE_UCHAR),
+                              &array, G_TYPE_INVALID))
+  {
+    g_warning ("Unable to get %s from SystemInfo: %s",
+               value->key, error->message);
+    g_error_free (error);
+
+    state = HCP_SYS_INFO_FAILED;
+    array = NULL;
+  }
+
+  if (state == value->state &&
+      hcp_sys_info_same_value (array, value->value))
+  {
+    if (array)
+      g_array_free (array, TRUE);
+  }
+  else
+  {
+    if (value->value)
+      g_array_free (value->value, TRUE);
+
+    value->state = state;
+    value->value = array;
+
+    priv->dirty = TRUE;
+  }
+
+  /* Let the whole batch come in before reporting */
+  if (priv->n_pending == 0 && priv->dirty)
+  {
+    priv->dirty = FALSE;
+
+    g_signal_emit (G_OBJECT (value->info),
+                   signals[SIGNAL_CHANGED],
+                   0);
+  }
+}
+
+static void
+hcp_sys_info_name_owner_changed_cb (DBusGProxy  *bus_proxy,
+                                    const gchar *name,
+                                    const gchar *old_owner,
+                                    const gchar *new_owner,
+                                    HCPSysInfo  *info)
+{
+  /* A restarted SystemInfo may answer differently */
+  if (!strcmp (name, SYSINFO_SERVICE_DBUS) && new_owner && *new_owner)
+    hcp_sys_info_invalidate (info);
+}
+
+static DBusGProxy *
+hcp_sys_info_get_proxy (HCPSysInfo *info)
+{
+  HCPSysInfoPrivate *priv = info->priv;
+  DBusGConnection *connection;
+  DBusBusType bus_type = DBUS_BUS_SYSTEM;
+  const gchar *bus_env;
+  GError *error = NULL;
+
+  if (priv->proxy || priv->bus_failed)
+    return priv->proxy;
+
+  bus_env = g_getenv (HCP_SYS_INFO_BUS_ENV);
+
+  if (bus_env && !strcmp (bus_env, "session"))
+    bus_type = DBUS_BUS_SESSION;
+
+  connection = dbus_g_bus_get (bus_type, &error);
+
+  if (connection == NULL)
+  {
+    g_warning ("Could not connect to dbus: %s", error->message);
+    g_error_free (error);
+
+    /* Don't try again for every key */
+    priv->bus_failed = TRUE;
+
+    return NULL;
+  }
+
+  priv->proxy = dbus_g_proxy_new_for_name (connection,
+                                           SYSINFO_SERVICE_DBUS,
+                                           SYSINFO_PATH_DBUS,
+                                           SYSINFO_INTERFACE_DBUS);
+
+  priv->bus_proxy = dbus_g_proxy_new_for_name (connection,
+                                               BUS_SERVICE_DBUS,
+                                               BUS_PATH_DBUS,
+                                               BUS_INTERFACE_DBUS);
+
+  dbus_g_object_register_marshaller (hcp_marshal_VOID__STRING_STRING_STRING,
+                                     G_TYPE_NONE,
+                                     G_TYPE_STRING,
+                                     G_TYPE_STRING,
+                                     G_TYPE_STRING,
+                                     G_TYPE_INVALID);
+
+  dbus_g_proxy_add_signal (priv->bus_proxy, "NameOwnerChanged",
+                           G_TYPE_STRING,
+                           G_TYPE_STRING,
+                           G_TYPE_STRING,
+                           G_TYPE_INVALID);
+
+  dbus_g_proxy_connect_signal (priv->bus_proxy, "NameOwnerChanged",
+                               G_CALLBACK (hcp_sys_info_name_owner_changed_cb),
+                               info, NULL);
+
+  dbus_g_connection_unref (connection);
+
+  return priv->proxy;
+}
+
+static void
+hcp_sys_info_probe (HCPSysInfo *info, HCPSysInfoValue *value)
+{
+  DBusGProxy *proxy = hcp_sys_info_get_proxy (info);
+
+  if (proxy == NULL)
+  {
+    value->state = HCP_SYS_INFO_FAILED;
+    return;
+  }
+
+  hcp_sys_info_cancel_call (value);
+
+  info->priv->n_pending++;
+
+  value->call = dbus_g_proxy_begin_call (proxy,
+                                         SYSINFO_METHOD,
+                                         (DBusGProxyCallNotify) hcp_sys_info_reply_cb,
+                                         value,
+                                         NULL,
+                                         G_TYPE_STRING,
+                                         value->key,
+                                         G_TYPE_INVALID);
+}
+
+static void
+hcp_sys_info_init (HCPSysInfo *info)
+{
+  info->priv = HCP_SYS_INFO_GET_PRIVATE (info);
+
+  info->priv->proxy = NULL;
+  info->priv->bus_proxy = NULL;
+  info->priv->bus_failed = FALSE;
+  info->priv->n_pending = 0;
+  info->priv->dirty = FALSE;
+  info->priv->values = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                              NULL,
+                                              (GDestroyNotify) hcp_sys_info_free_value);
+}
+
+static void
+hcp_sys_info_finalize (GObject *object)
+{
+  HCPSysInfoPrivate *priv;
+
+  g_return_if_fail (object);
+  g_return_if_fail (HCP_IS_SYS_INFO (object));
+
+  priv = HCP_SYS_INFO (object)->priv;
+
+  /* Cancels the calls still in flight */
+  g_hash_table_destroy (priv->values);
+
+  if (priv->bus_proxy)
+  {
+    dbus_g_proxy_disconnect_signal (priv->bus_proxy, "NameOwnerChanged",
+                                    G_CALLBACK (hcp_sys_info_name_owner_changed_cb),
+                                    object);
+    g_object_unref (priv->bus_proxy);
+  }
+
+  if (priv->proxy)
+    g_object_unref (priv->proxy);
+
+  G_OBJECT_CLASS (hcp_sys_info_parent_class)->finalize (object);
+}
+
+static void
+hcp_sys_info_class_init (HCPSysInfoClass *class)
+{
+  GObjectClass *g_object_class = (GObjectClass *) class;
+
+  g_object_class->finalize = hcp_sys_info_finalize;
+
+  signals[SIGNAL_CHANGED] =
+        g_signal_new ("changed",
+                      G_OBJECT_CLASS_TYPE (g_object_class),
+                      G_SIGNAL_RUN_FIRST,
+                      G_STRUCT_OFFSET (HCPSysInfoClass, changed),
+                      NULL, NULL,
+                      g_cclosure_marshal_VOID__VOID,
+                      G_TYPE_NONE, 0);
+
+  g_type_class_add_private (g_object_class, sizeof (HCPSysInfoPrivate));
+}
+
+HCPSysInfo *
+hcp_sys_info_new (void)
+{
+  return g_object_new (HCP_TYPE_SYS_INFO, NULL);
+}
+
+static HCPSysInfoValue *
+hcp_sys_info_get_value (HCPSysInfo *info, const gchar *key)
+{
+  HCPSysInfoValue *cached;
+
+  cached = g_hash_table_lookup (info->priv->values, key);
+
+  if (cached == NULL)
+  {
+    cached = g_new0 (HCPSysInfoValue, 1);
+
+    cached->info = info;
+    cached->key = g_strdup (key);
+    cached->state = HCP_SYS_INFO_PENDING;
+
+    g_hash_table_insert (info->priv->values, cached->key, cached);
+
+    hcp_sys_info_probe (info, cached);
+  }
+
+  return cached;
+}
+
+/* Never blocks: the first lookup of a key starts the D-Bus call and
+ * returns HCP_SYS_INFO_PENDING, "changed" is emitted once the answer
+ * is in. value is owned by info. */
+HCPSysInfoState
+hcp_sys_info_lookup (HCPSysInfo   *info,
+                     const gchar  *key,
+                     GArray      **value)
+{
+  HCPSysInfoValue *cached;
+
+  g_return_val_if_fail (info, HCP_SYS_INFO_FAILED);
+  g_return_val_if_fail (HCP_IS_SYS_INFO (info), HCP_SYS_INFO_FAILED);
+  g_return_val_if_fail (key, HCP_SYS_INFO_FAILED);
+
+  cached = hcp_sys_info_get_value (info, key);
+
+  if (value)
+    *value = cached->value;
+
+  return cached->state;
+}
+
+/* Splits one "KEY=VALUE" or "KEY!=VALUE" clause. KEY may end in
+ * "[N]" to compare only byte N of the value, as a decimal number;
+ * *byte is -1 otherwise. */
+static gboolean
+hcp_sys_info_parse_clause (const gchar  *clause,
+                           gchar       **key,
+                           gchar       **expected,
+                           gboolean     *negate,
+                           gint         *byte)
+{
+  const gchar *eq = strchr (clause, '=');
+  gchar *bracket;
+
+  if (eq == NULL || eq == clause)
+    return FALSE;
+
+  *negate = (eq[-1] == '!');
+
+  *key = g_strndup (clause, eq - clause - (*negate ? 1 : 0));
+  *expected = g_strdup (eq + 1);
+  *byte = -1;
+
+  g_strstrip (*key);
+  g_strstrip (*expected);
+
+  bracket = strrchr (*key, '[');
+
+  if (bracket != NULL && g_str_has_suffix (bracket, "]"))
+  {
+    gchar *end;
+    gulong index = strtoul (bracket + 1, &end, 10);
+
+    if (end == bracket + 1 || *end != ']' || index > G_MAXINT)
+    {
+      g_free (*key);
+      g_free (*expected);
+
+      return FALSE;
+    }
+
+    *byte = (gint) index;
+    *bracket = '\0';
+    g_strchomp (*key);
+  }
+
+  if (**key == '\0')
+  {
+    g_free (*key);
+    g_free (*expected);
+
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* SystemInfo values are byte arrays. Printable ones compare as text,
+ * anything else as comma separated decimal bytes, e.g. "1" for the
+ * single byte pp bits. With byte >= 0 only that byte is converted,
+ * always as a decimal number. */
+static gchar *
+hcp_sys_info_value_to_string (GArray *value, gint byte)
+{
+  GString *string;
+  gboolean printable;
+  guint i;
+
+  if (value == NULL)
+    return g_strdup ("");
+
+  if (byte >= 0)
+  {
+    if ((guint) byte >= value->len)
+      return g_strdup ("");
+
+    return g_strdup_printf ("%u", (guint) g_array_index (value, guchar, byte));
+  }
+
+  printable = value->len > 0;
+
+  for (i = 0; i < value->len && printable; i++)
+  {
+    guchar c = g_array_index (value, guchar, i);
+
+    printable = (c >= 0x20 && c < 0x7f);
+  }
+
+  if (printable)
+    return g_strndup (value->data, value->len);
+
+  string = g_string_new (NULL);
+
+  for (i = 0; i < value->len; i++)
+  {
+    g_string_append_printf (string, i ? ",%u" : "%u",
+                            (guint) g_array_index (value, guchar, i));
+  }
+
+  return g_string_free (string, FALSE);
+}
+
+/* Starts the queries for all the keys named by the requirement
+ * strings in requirements (a set) at once; the replies are reported
+ * with a single "changed" */
+void
+hcp_sys_info_prefetch (HCPSysInfo *info, GHashTable *requirements)
+{
+  GHashTableIter iter;
+  gpointer requires;
+
+  g_return_if_fail (info);
+  g_return_if_fail (HCP_IS_SYS_INFO (info));
+  g_return_if_fail (requirements);
+
+  g_hash_table_iter_init (&iter, requirements);
+
+  while (g_hash_table_iter_next (&iter, &requires, NULL))
+  {
+    gchar **clauses;
+    guint i;
+
+    clauses = g_strsplit ((const gchar *) requires, ";", -1);
+
+    for (i = 0; clauses[i]; i++)
+    {
+      gchar *key, *expected;
+      gboolean negate;
+      gint byte;
+
+      if (!hcp_sys_info_parse_clause (clauses[i], &key, &expected,
+                                      &negate, &byte))
+        continue;
+
+      hcp_sys_info_get_value (info, key);
+
+      g_free (key);
+      g_free (expected);
+    }
+
+    g_strfreev (clauses);
+  }
+}
+
+/*
+ * requires is a ';' separated list of "KEY=VALUE" or "KEY!=VALUE"
+ * clauses on SystemInfo configuration keys, all of which must hold.
+ * "KEY[N]=VALUE" compares byte N of the value alone, e.g.
+ * "/certs/ccc/pp/fmtx-raw[0]!=1"; a missing byte compares as "".
+ * A key that cannot be read never satisfies a clause, and a
+ * malformed clause is never met either.
+ */
+HCPSysInfoMatch
+hcp_sys_info_match (HCPSysInfo *info, const gchar *requires)
+{
+  HCPSysInfoMatch match = HCP_SYS_INFO_MET;
+  gchar **clauses;
+  guint i;
+
+  g_return_val_if_fail (info, HCP_SYS_INFO_UNMET);
+  g_return_val_if_fail (HCP_IS_SYS_INFO (info), HCP_SYS_INFO_UNMET);
+
+  if (requires == NULL)
+    return HCP_SYS_INFO_MET;
+
+  clauses = g_strsplit (requires, ";", -1);
+
+  for (i = 0; clauses[i] && match != HCP_SYS_INFO_UNMET; i++)
+  {
+    HCPSysInfoValue *value;
+    gchar *key, *expected, *actual;
+    gboolean negate;
+    gint byte;
+
+    g_strstrip (clauses[i]);
+
+    if (*clauses[i] == '\0')
+      continue;
+
+    if (!hcp_sys_info_parse_clause (clauses[i], &key, &expected,
+                                    &negate, &byte))
+    {
+      g_warning ("Invalid applet requirement: %s", clauses[i]);
+      match = HCP_SYS_INFO_UNMET;
+      break;
+    }
+
+    value = hcp_sys_info_get_value (info, key);
+
+    switch (value->state)
+    {
+      case HCP_SYS_INFO_PENDING:
+        match = HCP_SYS_INFO_UNKNOWN;
+        break;
+
+      case HCP_SYS_INFO_FAILED:
+        match = HCP_SYS_INFO_UNMET;
+        break;
+
+      case HCP_SYS_INFO_AVAILABLE:
+        actual = hcp_sys_info_value_to_string (value->value, byte);
+
+        if ((strcmp (actual, expected) == 0) == negate)
+          match = HCP_SYS_INFO_UNMET;
+
+        g_free (actual);
+        break;
+    }
+
+    g_free (key);
+    g_free (expected);
+  }
+
+  g_strfreev (clauses);
+
+  return match;
+}
+
+/* Queries all the known keys again. The old values stay visible
+ * until the new ones arrive, "changed" is only emitted for keys
+ * whose value actually changed. */
+void
+hcp_sys_info_invalidate (HCPSysInfo *info)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  g_return_if_fail (info);
+  g_return_if_fail (HCP_IS_SYS_INFO (info));
+
+  info->priv->bus_failed = FALSE;
+
+  g_hash_table_iter_init (&iter, info->priv->values);
+
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    hcp_sys_info_probe (info, (HCPSysInfoValue *) value);
+}
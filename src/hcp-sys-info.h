@@ -0,0 +1,91 @@
+/*
+ * This file is part of hildon-control-panel
+ *
+ * Copyright (C) 2010 Nokia Corporation.
+ *
+ * Contact: Karoliina Salminen <karoliina.t.salminen@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef HCP_SYS_INFO_H
+#define HCP_SYS_INFO_H
+
+#include <glib.h>
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+typedef struct _HCPSysInfo HCPSysInfo;
+typedef struct _HCPSysInfoClass HCPSysInfoClass;
+typedef struct _HCPSysInfoPrivate HCPSysInfoPrivate;
+
+#define HCP_TYPE_SYS_INFO            (hcp_sys_info_get_type ())
+#define HCP_SYS_INFO(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), HCP_TYPE_SYS_INFO, HCPSysInfo))
+#define HCP_SYS_INFO_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass),  HCP_TYPE_SYS_INFO, HCPSysInfoClass))
+#define HCP_IS_SYS_INFO(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), HCP_TYPE_SYS_INFO))
+#define HCP_IS_SYS_INFO_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass),  HCP_TYPE_SYS_INFO))
+#define HCP_SYS_INFO_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj),  HCP_TYPE_SYS_INFO, HCPSysInfoClass))
+
+typedef enum
+{
+  HCP_SYS_INFO_PENDING,
+  HCP_SYS_INFO_AVAILABLE,
+  HCP_SYS_INFO_FAILED
+} HCPSysInfoState;
+
+typedef enum
+{
+  HCP_SYS_INFO_UNKNOWN,
+  HCP_SYS_INFO_MET,
+  HCP_SYS_INFO_UNMET
+} HCPSysInfoMatch;
+
+struct _HCPSysInfo
+{
+  GObject gobject;
+
+  HCPSysInfoPrivate *priv;
+};
+
+struct _HCPSysInfoClass
+{
+  GObjectClass parent_class;
+
+  /* Emitted once all the replies of a batch of queries arrived,
+   * if any of the values changed */
+  void (*changed) (HCPSysInfo *info);
+};
+
+GType            hcp_sys_info_get_type    (void);
+
+HCPSysInfo*      hcp_sys_info_new         (void);
+
+HCPSysInfoState  hcp_sys_info_lookup      (HCPSysInfo   *info,
+                                           const gchar  *key,
+                                           GArray      **value);
+
+void             hcp_sys_info_prefetch    (HCPSysInfo   *info,
+                                           GHashTable   *requirements);
+
+HCPSysInfoMatch  hcp_sys_info_match       (HCPSysInfo   *info,
+                                           const gchar  *requires);
+
+void             hcp_sys_info_invalidate  (HCPSysInfo   *info);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,320 @@
+/*
+ * This file is part of hildon-control-panel
+ *
+ * Copyright (C) 2010 Nokia Corporation.
+ *
+ * Contact: Karoliina Salminen <karoliina.t.salminen@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "hcp-trace.h"
+
+typedef struct
+{
+  gchar        phase;    /* 'B', 'E' or 'i' as in the trace format */
+  const gchar *name;
+  gchar       *detail;
+  gint64       ts;       /* microseconds since hcp_trace_init () */
+  guint        tid;
+} HCPTraceEvent;
+
+/* Time spent in the events of one name, for the summary */
+typedef struct
+{
+  const gchar *name;
+  gchar        phase;
+  gint64       total;
+  guint        count;
+} HCPTracePhase;
+
+/* Set once by hcp_trace_init (), before any other thread runs */
+static gboolean  trace_enabled = FALSE;
+static gchar    *trace_filename = NULL;
+static gint64    trace_start = 0;
+
+G_LOCK_DEFINE_STATIC (trace);
+static GArray   *trace_events = NULL;
+static guint     trace_n_threads = 0;
+
+/* Small per thread number, the main thread is 1 */
+static GPrivate  trace_thread_id = G_PRIVATE_INIT (NULL);
+
+static guint
+hcp_trace_get_thread_id (void)
+{
+  gpointer id = g_private_get (&trace_thread_id);
+
+  if (id == NULL)
+  {
+    id = GUINT_TO_POINTER (++trace_n_threads);
+    g_private_set (&trace_thread_id, id);
+  }
+
+  return GPOINTER_TO_UINT (id);
+}
+
+static void
+hcp_trace_add (gchar phase, const gchar *name, const gchar *detail)
+{
+  HCPTraceEvent event;
+
+  if (!trace_enabled)
+    return;
+
+  event.phase = phase;
+  event.name = name;
+  event.detail = g_strdup (detail);
+  event.ts = g_get_monotonic_time () - trace_start;
+
+  G_LOCK (trace);
+
+  event.tid = hcp_trace_get_thread_id ();
+  g_array_append_val (trace_events, event);
+
+  G_UNLOCK (trace);
+}
+
+static void
+hcp_trace_append_escaped (GString *json, const gchar *str)
+{
+  const gchar *p;
+
+  for (p = str; *p; p++)
+  {
+    if (*p == '"' || *p == '\\')
+      g_string_append_printf (json, "\\%c", *p);
+    else if ((guchar) *p < 0x20)
+      g_string_append_printf (json, "\\u%04x", (guint) *p);
+    else
+      g_string_append_c (json, *p);
+  }
+}
+
+static HCPTracePhase *
+hcp_trace_get_phase (GArray *phases, const gchar *name, gchar phase)
+{
+  HCPTracePhase new_phase;
+  guint i;
+
+  for (i = 0; i < phases->len; i++)
+  {
+    HCPTracePhase *p = &g_array_index (phases, HCPTracePhase, i);
+
+    if (p->phase == phase && !strcmp (p->name, name))
+      return p;
+  }
+
+  new_phase.name = name;
+  new_phase.phase = phase;
+  new_phase.total = 0;
+  new_phase.count = 0;
+
+  g_array_append_val (phases, new_phase);
+
+  return &g_array_index (phases, HCPTracePhase, phases->len - 1);
+}
+
+/* One line with the time of each phase, in the order they started.
+ * An end is matched with the last begin of the same name on the same
+ * thread. Called with the lock held. */
+static gchar *
+hcp_trace_summarize (void)
+{
+  GArray *phases;
+  GString *summary;
+  gboolean *matched;
+  guint i, j;
+
+  phases = g_array_new (FALSE, FALSE, sizeof (HCPTracePhase));
+  matched = g_new0 (gboolean, trace_events->len);
+
+  for (i = 0; i < trace_events->len; i++)
+  {
+    HCPTraceEvent *event = &g_array_index (trace_events, HCPTraceEvent, i);
+
+    if (event->phase == 'i')
+    {
+      HCPTracePhase *phase = hcp_trace_get_phase (phases, event->name, 'i');
+
+      if (phase->count++ == 0)
+        phase->total = event->ts;
+    }
+    else if (event->phase == 'B')
+    {
+      hcp_trace_get_phase (phases, event->name, 'B');
+    }
+    else
+    {
+      for (j = i; j > 0; j--)
+      {
+        HCPTraceEvent *begin = &g_array_index (trace_events, HCPTraceEvent, j - 1);
+
+        if (!matched[j - 1] && begin->phase == 'B' &&
+            begin->tid == event->tid && !strcmp (begin->name, event->name))
+        {
+          HCPTracePhase *phase = hcp_trace_get_phase (phases, event->name, 'B');
+
+          matched[j - 1] = TRUE;
+          phase->total += event->ts - begin->ts;
+          phase->count++;
+          break;
+        }
+      }
+    }
+  }
+
+  summary = g_string_new ("hcp-trace:");
+
+  for (i = 0; i < phases->len; i++)
+  {
+    HCPTracePhase *phase = &g_array_index (phases, HCPTracePhase, i);
+
+    g_string_append_printf (summary, "%s %s", i > 0 ? "," : "", phase->name);
+
+    if (phase->phase == 'i')
+      g_string_append (summary, " at");
+    else if (phase->count != 1)
+      g_string_append_printf (summary, " %ux", phase->count);
+
+    g_string_append_printf (summary, " %.1f ms", phase->total / 1000.0);
+  }
+
+  g_string_append_printf (summary, "; trace in %s", trace_filename);
+
+  g_free (matched);
+  g_array_free (phases, TRUE);
+
+  return g_string_free (summary, FALSE);
+}
+
+/* Reads HCP_TRACE, to be called first thing in main () */
+void
+hcp_trace_init (void)
+{
+  const gchar *filename = g_getenv (HCP_TRACE_ENV);
+
+  if (trace_enabled || filename == NULL || *filename == '\0')
+    return;
+
+  trace_filename = g_strdup (filename);
+  trace_start = g_get_monotonic_time ();
+  trace_events = g_array_new (FALSE, FALSE, sizeof (HCPTraceEvent));
+
+  /* Makes the calling thread the first one */
+  hcp_trace_get_thread_id ();
+
+  trace_enabled = TRUE;
+}
+
+gboolean
+hcp_trace_enabled (void)
+{
+  return trace_enabled;
+}
+
+/* detail, if not NULL, is shown in the arguments of the event */
+void
+hcp_trace_begin (const gchar *name, const gchar *detail)
+{
+  hcp_trace_add ('B', name, detail);
+}
+
+void
+hcp_trace_end (const gchar *name)
+{
+  hcp_trace_add ('E', name, NULL);
+}
+
+/* A point in time rather than a span */
+void
+hcp_trace_mark (const gchar *name)
+{
+  hcp_trace_add ('i', name, NULL);
+}
+
+/* Writes all the events so far and prints the summary. Can be called
+ * again later, the file is then replaced with the longer trace. */
+void
+hcp_trace_write (void)
+{
+  GString *json;
+  GError *error = NULL;
+  gchar *summary;
+  guint i;
+
+  if (!trace_enabled)
+    return;
+
+  json = g_string_new ("{\"traceEvents\":[\n");
+
+  G_LOCK (trace);
+
+  for (i = 0; i < trace_events->len; i++)
+  {
+    HCPTraceEvent *event = &g_array_index (trace_events, HCPTraceEvent, i);
+
+    g_string_append_printf (json,
+                            "%s{\"name\":\"%s\",\"cat\":\"startup\","
+                            "\"ph\":\"%c\",\"ts\":%" G_GINT64_FORMAT ","
+                            "\"pid\":%d,\"tid\":%u",
+                            i > 0 ? ",\n" : "",
+                            event->name,
+                            event->phase,
+                            event->ts,
+                            (gint) getpid (),
+                            event->tid);
+
+    /* Instant events span the whole process */
+    if (event->phase == 'i')
+      g_string_append (json, ",\"s\":\"p\"");
+
+    if (event->detail)
+    {
+      g_string_append (json, ",\"args\":{\"detail\":\"");
+      hcp_trace_append_escaped (json, event->detail);
+      g_string_append (json, "\"}");
+    }
+
+    g_string_append_c (json, '}');
+  }
+
+  summary = hcp_trace_summarize ();
+
+  G_UNLOCK (trace);
+
+  g_string_append (json, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+  if (!g_file_set_contents (trace_filename, json->str, json->len, &error))
+  {
+    g_warning ("Error writing startup trace: %s", error->message);
+    g_error_free (error);
+  }
+
+  g_printerr ("%s\n", summary);
+
+  g_free (summary);
+  g_string_free (json, TRUE);
+}
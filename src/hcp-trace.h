@@ -0,0 +1,54 @@
+/*
+ * This file is part of hildon-control-panel
+ *
+ * Copyright (C) 2010 Nokia Corporation.
+ *
+ * Contact: Karoliina Salminen <karoliina.t.salminen@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef HCP_TRACE_H
+#define HCP_TRACE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Startup tracing. Setting HCP_TRACE to a file name makes the phases
+ * below be timed with the monotonic clock and written to that file
+ * in the Chrome trace event format (chrome://tracing, Perfetto), with
+ * a one line summary on stderr. Can be called from any thread, and
+ * does nothing unless enabled. Event names have to be string
+ * literals, they are not copied. */
+#define HCP_TRACE_ENV  "HCP_TRACE"
+
+void      hcp_trace_init    (void);
+
+gboolean  hcp_trace_enabled (void);
+
+void      hcp_trace_begin   (const gchar *name,
+                             const gchar *detail);
+
+void      hcp_trace_end     (const gchar *name);
+
+void      hcp_trace_mark    (const gchar *name);
+
+void      hcp_trace_write   (void);
+
+G_END_DECLS
+
+#endif
@@ -46,6 +46,7 @@
 #include "hcp-app.h"
 #include "hcp-grid.h"
 #include "hcp-config-keys.h"
+#include "hcp-trace.h"
 
 #ifdef MAEMO_TOOLS
 #include "hcp-rfs.h"
@@ -274,7 +275,6 @@ hcp_window_save_state (HCPWindow *window, gboolean clear_state)
   osso_state_t state = { 0, };
   GKeyFile *keyfile = NULL;
   osso_return_t ret;
-  gchar *focused = NULL;
   GError *error = NULL;
 
   g_return_if_fail (window);
@@ -297,16 +297,11 @@ hcp_window_save_state (HCPWindow *window, gboolean clear_state)
 
   keyfile = g_key_file_new ();
 
-  g_object_get (G_OBJECT (priv->focused_item),
-                "plugin", &focused,
-                NULL);
-
   g_key_file_set_string (keyfile,
                          HCP_STATE_GROUP,
                          HCP_STATE_FOCUSED,
-                         priv->focused_item?focused:"");
-
-  g_free (focused);
+                         priv->focused_item ?
+                         hcp_app_peek_plugin (priv->focused_item) : "");
   
   g_key_file_set_integer (keyfile,
                           HCP_STATE_GROUP,
@@ -496,42 +491,51 @@ hcp_window_app_view_focus_cb (HCPAppView *view,
   priv->focused_item = g_object_ref (app);
 }
 
+static void 
+hcp_window_app_list_apps_changed_cb (HCPAppList *al,
+                                     guint       generation,
+                                     GArray     *changes,
+                                     HCPWindow  *window)
+{
+  g_return_if_fail (window);
+  g_return_if_fail (HCP_IS_WINDOW (window));
+
+  hcp_app_view_apply_changes (HCP_APP_VIEW (window->priv->view),
+                              al,
+                              changes);
+}
+
 static void 
 hcp_window_app_list_updated_cb (HCPAppList *al, HCPWindow *window)
 {
   HCPWindowPrivate *priv;
   GHashTable *apps = NULL;
   HCPApp *app = NULL;
-  gchar *focused = NULL;
 
   g_return_if_fail (window);
   g_return_if_fail (HCP_IS_WINDOW (window));
 
   priv = window->priv;
 
-  /* Update the view */
-  hcp_app_view_populate (HCP_APP_VIEW (priv->view), al);
-
-  gtk_widget_show_all (priv->view);
-    
+  /* The view was already updated through "apps-changed" */
   if (priv->focused_item == NULL)
     return;
 	  
-  g_object_get (G_OBJECT (priv->focused_item),
-                "plugin", &focused,
-                NULL);
-
-  g_object_unref (priv->focused_item);
-  window->priv->focused_item = NULL;
-
   g_object_get (G_OBJECT (priv->al),
                 "apps", &apps,
                 NULL);
 
+  /* The focused item may be gone from the list, only drop it once
+   * done with its plugin name */
   app = g_hash_table_lookup (apps,
-                             focused);
+                             hcp_app_peek_plugin (priv->focused_item));
 
-  g_free (focused);
+  /* Still listed, its row and the focus were kept */
+  if (app == priv->focused_item)
+    return;
+
+  g_object_unref (priv->focused_item);
+  window->priv->focused_item = NULL;
 
   if (app)
     hcp_app_focus (app);
@@ -565,9 +569,13 @@ hcp_take_screenshot (gpointer data)
 }
 
 static gboolean
-_expose_cb (GtkWidget *widget, GdkEventExpose *event, gpointer data)
+_draw_cb (GtkWidget *widget, cairo_t *cr, gpointer data)
 {
   HCPProgram *program = hcp_program_get_instance ();
+
+  /* Runs after the view drew its first frame */
+  hcp_trace_mark ("first_frame");
+  hcp_trace_write ();
   
   g_timeout_add (80, hcp_take_screenshot, program->window);
 
@@ -832,6 +840,11 @@ hcp_window_init (HCPWindow *window)
   g_signal_connect (G_OBJECT (priv->view), "focus-changed",
                     G_CALLBACK (hcp_window_app_view_focus_cb), window);
 
+  /* After the grid's model replayed the changes on its rows */
+  g_signal_connect_after (G_OBJECT (priv->al), "apps-changed",
+                          G_CALLBACK (hcp_window_app_list_apps_changed_cb),
+                          window);
+
   g_signal_connect (G_OBJECT (priv->al), "updated",
                     G_CALLBACK (hcp_window_app_list_updated_cb), window);
 
@@ -840,12 +853,19 @@ hcp_window_init (HCPWindow *window)
 
   hcp_window_retrieve_state (window);
 
+  hcp_trace_begin ("construct_ui", NULL);
   hcp_window_construct_ui (window);
+  hcp_trace_end ("construct_ui");
 
+  /* Shows the list as HCPProgram has it, which is still empty while
+   * its first update runs; the view follows "apps-changed" from
+   * then on */
+  hcp_trace_begin ("populate", NULL);
   hcp_app_view_populate (HCP_APP_VIEW (priv->view), priv->al);
+  hcp_trace_end ("populate");
 
-  program->handler_id = g_signal_connect_after (G_OBJECT (priv->view), "expose-event",
-                          G_CALLBACK (_expose_cb), priv->view);
+  program->handler_id = g_signal_connect_after (G_OBJECT (priv->view), "draw",
+                          G_CALLBACK (_draw_cb), priv->view);
 }
 
 static void